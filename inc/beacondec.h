@@ -0,0 +1,79 @@
+/*
+ *  ____  ____      _    ____ ___ _   _  ___
+ *  |  _ \|  _ \    / \  / ___|_ _| \ | |/ _ \
+ *  | | | | |_) |  / _ \| |  _ | ||  \| | | | |
+ *  | |_| |  _ <  / ___ \ |_| || || |\  | |_| |
+ *  |____/|_| \_\/_/   \_\____|___|_| \_|\___/
+ *
+ * location service -- An opensource of lorawan location service
+ *
+ * See http://www.dragino.com for more information about
+ * the lora gateway project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ *
+ * Maintainer: skerlan
+ *
+ */
+
+/*! \file
+ *
+ * \brief binary iBeacon frame decoder
+ *
+ * Trackers report the beacons they hear as fixed size records in the raw
+ * LoRaWAN payload. A layout describes where the fields of a record are, one
+ * layout per device model, so the uplink can be decoded without the payload
+ * formatter of the network server.
+ *
+ * Multi byte fields are big endian, the rssi is a signed byte.
+ */
+
+#ifndef _LGW_BEACONDEC_H
+#define _LGW_BEACONDEC_H
+
+#include <stdint.h>
+
+#define MAX_FRAME_BEACONS       8       /* beacons decoded from one frame */
+#define BEACON_UUID_TAIL        12      /* hex chars of the uuid used to match a beacon */
+
+/*!
+ * \brief struct of frame layout of a device model
+ */
+typedef struct {
+    const char* name;           /* model name used in the configure */
+    int header;                 /* bytes before the first record */
+    int record;                 /* size of a record */
+    int uuid_off;               /* offset of the last 6 bytes of the uuid */
+    int major_off;
+    int minor_off;
+    int rssi_off;
+} beacon_layout_s;
+
+/*!
+ * \brief struct of one beacon heard by a tracker
+ */
+typedef struct {
+    char uuid[BEACON_UUID_TAIL + 1];    /* tail of the uuid, upper case hex */
+    int major;
+    int minor;
+    int rssi;
+} beacon_read_s;
+
+/*!
+ * \brief find a builtin layout
+ * \param name model name, case insensitive
+ * \retval the layout, NULL if unknown
+ */
+const beacon_layout_s* beacon_layout_find(const char* name);
+
+/*!
+ * \brief decode the records of a frame
+ * \param reads array of max beacons, sorted by rssi, the strongest first
+ * \retval number of beacons decoded, -1 if the frame size doesn't match the layout
+ */
+int beacon_decode_frame(const beacon_layout_s* layout, const uint8_t* frame, int len, beacon_read_s* reads, int max);
+
+#endif /* _LGW_BEACONDEC_H */
@@ -0,0 +1,162 @@
+/*
+ *  ____  ____      _    ____ ___ _   _  ___
+ *  |  _ \|  _ \    / \  / ___|_ _| \ | |/ _ \
+ *  | | | | |_) |  / _ \| |  _ | ||  \| | | | |
+ *  | |_| |  _ <  / ___ \ |_| || || |\  | |_| |
+ *  |____/|_| \_\/_/   \_\____|___|_| \_|\___/
+ *
+ * location service -- An opensource of lorawan location service
+ *
+ * See http://www.dragino.com for more information about
+ * the lora gateway project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ *
+ * Maintainer: skerlan
+ *
+ */
+
+/*! \file
+ *
+ * \brief registry of the mapwize beacons
+ *
+ * A beacon is identified by the tail of its uuid, its major and its minor.
+ * The three are packed into a 10 bytes binary key, the registry indexes the
+ * keys in an open addressing table, so matching a reading is one hash and
+ * usually a single probe, and a reading of an unknown beacon is rejected as
+ * fast.
+ *
+ * The beacons are stored by column, row i of every array is beacon i, so a
+ * probe only touches the key column and the fields are read from arrays
+ * without pointers. The strings live in one pool and are referenced by
+ * offset; the venue and owner ids, the same few values for thousands of
+ * beacons, are interned and stored once.
+ *
+ * Since the columns hold no pointers, a registry is saved to a file as is
+ * and loaded back with a single mmap, without parsing anything. A loaded
+ * registry is read only.
+ */
+
+#ifndef _LGW_BEACONREG_H
+#define _LGW_BEACONREG_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*!
+ * \brief struct of beacon key
+ */
+typedef struct {
+    uint64_t uuid_major;        /* 48 bits of uuid tail, then the 16 bits major */
+    uint16_t minor;
+} beacon_key_s;
+
+/*!
+ * \brief struct of the fields of a beacon given to beacon_reg_add, the strings are copied
+ */
+typedef struct {
+    const char* id;
+    const char* venueid;
+    const char* orgid;
+    const char* place_tail;     /* precompiled end of the place document */
+    int place_tail_len;
+    int floor;
+    double lat;
+    double lon;
+} beacon_info_s;
+
+/*!
+ * \brief struct of beacon registry
+ */
+typedef struct {
+    /* columns, one row per beacon */
+    int count;
+    int capacity;
+    beacon_key_s* key;
+    int32_t* floor;
+    double* lat;
+    double* lon;
+    uint32_t* id;               /* offsets in pool */
+    uint32_t* venueid;
+    uint32_t* orgid;
+    uint32_t* place_tail;
+    uint32_t* place_tail_len;
+
+    /* key index */
+    uint32_t* slot;             /* row + 1, 0 for a free slot */
+    uint32_t mask;              /* number of slots - 1, a power of 2 */
+
+    /* string pool, null terminated strings */
+    char* pool;
+    uint32_t pool_len;
+    uint32_t pool_size;
+    uint32_t* str_slot;         /* offset + 1 of the interned strings, 0 for a free slot */
+    uint32_t str_mask;
+    int str_count;
+
+    /* mapping of a loaded registry, the columns point into it */
+    void* map;
+    size_t map_len;
+} beacon_reg_s;
+
+/*!
+ * \brief string of an offset in the pool
+ */
+#define beacon_reg_str(reg, ref)    ((const char*)(reg)->pool + (ref))
+
+/*!
+ * \brief pack a beacon key
+ * \param uuid the last BEACON_UUID_TAIL hex chars of the uuid, any case
+ * \retval 0 on success, -1 if uuid is not hex or major/minor are out of range
+ */
+int beacon_key_make(beacon_key_s* key, const char* uuid, int major, int minor);
+
+/*!
+ * \brief initialize an empty registry
+ */
+void beacon_reg_init(beacon_reg_s* reg);
+
+/*!
+ * \brief add a beacon, the index grows to keep it at most half full
+ * \param row set to the row of the beacon, may be NULL
+ * \retval 0 on success, 1 if the key is already registered (row of the first one), -1 on allocation failure
+ * or if the registry was loaded from a snapshot
+ */
+int beacon_reg_add(beacon_reg_s* reg, const beacon_key_s* key, const beacon_info_s* info, int* row);
+
+/*!
+ * \brief find the beacon of a key
+ * \retval row of the beacon, -1 if unknown
+ */
+int beacon_reg_find(const beacon_reg_s* reg, const beacon_key_s* key);
+
+/*!
+ * \brief save the registry to a snapshot file, written aside then renamed
+ * \param tags strings saved with the registry (e.g. the configure it was built with), NULL is saved as ""
+ * \param checksum checksum of the snapshot on disk, 0 if none; nothing is written if it doesn't change, updated on success
+ * \retval 0 on success, 1 if the snapshot is unchanged, -1 on failure
+ */
+int beacon_reg_save(const beacon_reg_s* reg, const char* path, const char* const* tags, int ntags, uint32_t* checksum);
+
+/*!
+ * \brief map a snapshot file as a read only registry
+ * \param tags set to the saved tags, they point into the mapping
+ * \param checksum set to the checksum of the snapshot, may be NULL
+ * \retval 0 on success, -1 if the file is missing, of another version, truncated or corrupted
+ */
+int beacon_reg_load(beacon_reg_s* reg, const char* path, const char** tags, int ntags, uint32_t* checksum);
+
+/*!
+ * \brief bytes allocated by the registry
+ */
+size_t beacon_reg_memory(const beacon_reg_s* reg);
+
+/*!
+ * \brief free or unmap the registry
+ */
+void beacon_reg_free(beacon_reg_s* reg);
+
+#endif /* _LGW_BEACONREG_H */
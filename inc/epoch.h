@@ -0,0 +1,100 @@
+/*
+ *  ____  ____      _    ____ ___ _   _  ___
+ *  |  _ \|  _ \    / \  / ___|_ _| \ | |/ _ \
+ *  | | | | |_) |  / _ \| |  _ | ||  \| | | | |
+ *  | |_| |  _ <  / ___ \ |_| || || |\  | |_| |
+ *  |____/|_| \_\/_/   \_\____|___|_| \_|\___/
+ *
+ * location service -- An opensource of lorawan location service
+ *
+ * See http://www.dragino.com for more information about
+ * the lora gateway project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ *
+ * Maintainer: skerlan
+ *
+ */
+
+/*! \file
+ *
+ * \brief epoch based reclamation of shared snapshots
+ *
+ * A writer publishes a new snapshot with an atomic pointer store and retires
+ * the old one; readers never block, they only mark the epoch they entered
+ * in their own slot. A retired snapshot is released once every reader is
+ * either outside or entered after the retire, so none can still hold it.
+ *
+ * There is one writer: lgw_epoch_retire, lgw_epoch_reclaim and
+ * lgw_epoch_destroy must not run concurrently.
+ */
+
+#ifndef _LGW_EPOCH_H
+#define _LGW_EPOCH_H
+
+#include <stdint.h>
+
+#define EPOCH_MAX_READERS       8
+
+/*!
+ * \brief struct of retired snapshot
+ */
+typedef struct _epoch_retired_s {
+    struct _epoch_retired_s* next;
+    void* ptr;
+    void (*release)(void* ptr);
+    uint64_t epoch;                 /* safe when no reader is inside an older epoch */
+} epoch_retired_s;
+
+/*!
+ * \brief struct of epoch domain
+ */
+typedef struct {
+    uint64_t epoch;                         /* global epoch, starts at 1 */
+    uint64_t reader[EPOCH_MAX_READERS];     /* epoch entered by each reader, 0 when outside */
+    int readers;                            /* number of registered readers */
+    epoch_retired_s* retired;               /* writer only */
+} lgw_epoch_s;
+
+/*!
+ * \brief initialize an epoch domain
+ */
+void lgw_epoch_init(lgw_epoch_s* ep);
+
+/*!
+ * \brief register a reader thread
+ * \retval index of the reader, -1 if there are already EPOCH_MAX_READERS
+ */
+int lgw_epoch_register(lgw_epoch_s* ep);
+
+/*!
+ * \brief enter a read side critical section, load the shared pointers after this
+ */
+void lgw_epoch_enter(lgw_epoch_s* ep, int reader);
+
+/*!
+ * \brief leave a read side critical section, the loaded pointers must not be used after this
+ */
+void lgw_epoch_exit(lgw_epoch_s* ep, int reader);
+
+/*!
+ * \brief retire an unpublished snapshot, released by a later lgw_epoch_reclaim
+ * \param release called with ptr once no reader can hold it
+ */
+void lgw_epoch_retire(lgw_epoch_s* ep, void* ptr, void (*release)(void* ptr));
+
+/*!
+ * \brief release the retired snapshots no reader can hold anymore
+ * \retval number of snapshots still retired
+ */
+int lgw_epoch_reclaim(lgw_epoch_s* ep);
+
+/*!
+ * \brief release all the retired snapshots, no reader may be inside
+ */
+void lgw_epoch_destroy(lgw_epoch_s* ep);
+
+#endif /* _LGW_EPOCH_H */
@@ -0,0 +1,114 @@
+/*
+ *  ____  ____      _    ____ ___ _   _  ___
+ *  |  _ \|  _ \    / \  / ___|_ _| \ | |/ _ \
+ *  | | | | |_) |  / _ \| |  _ | ||  \| | | | |
+ *  | |_| |  _ <  / ___ \ |_| || || |\  | |_| |
+ *  |____/|_| \_\/_/   \_\____|___|_| \_|\___/
+ *
+ * location service -- An opensource of lorawan location service
+ *
+ * See http://www.dragino.com for more information about
+ * the lora gateway project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ *
+ * Maintainer: skerlan
+ *
+ */
+
+/*! \file
+ *
+ * \brief single pass JSON field extractor
+ *
+ * A list of wanted dot paths (e.g. "payload_fields.UUID") is compiled once.
+ * json_scan() then walks a document a single time, descends only into the
+ * objects which lead to a wanted path, skips everything else (e.g. the
+ * metadata.gateways array of a TTN uplink) without looking inside, and stops
+ * as soon as every path is found. Nothing is allocated: the results point
+ * into the scanned buffer.
+ */
+
+#ifndef _LGW_JSONSCAN_H
+#define _LGW_JSONSCAN_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define JSON_SCAN_MAX_PATHS     32      /* paths of one scanner */
+#define JSON_SCAN_MAX_DEPTH     8       /* levels of one path */
+
+/*!
+ * \brief type of a scanned value, same numbering as parson JSON_Value_Type
+ */
+typedef enum {
+    JSON_SCAN_NONE = 0,
+    JSON_SCAN_NULL = 1,
+    JSON_SCAN_STRING = 2,
+    JSON_SCAN_NUMBER = 3,
+    JSON_SCAN_OBJECT = 4,
+    JSON_SCAN_ARRAY = 5,
+    JSON_SCAN_BOOLEAN = 6
+} json_scan_type_e;
+
+/*!
+ * \brief struct of one compiled path
+ */
+typedef struct {
+    int depth;                                  /* number of levels */
+    const char* level[JSON_SCAN_MAX_DEPTH];     /* level names, point into the path */
+    size_t len[JSON_SCAN_MAX_DEPTH];            /* length of the level names */
+} json_scan_path_s;
+
+/*!
+ * \brief struct of a compiled scanner
+ */
+typedef struct {
+    int count;
+    json_scan_path_s path[JSON_SCAN_MAX_PATHS];
+} json_scan_s;
+
+/*!
+ * \brief struct of a scanned value
+ *
+ * For strings ptr/len cover the text between the quotes, still escaped when
+ * escaped is set; for other types they cover the raw JSON text of the value.
+ */
+typedef struct {
+    json_scan_type_e type;
+    const char* ptr;
+    size_t len;
+    int escaped;
+} json_scan_value_s;
+
+/*!
+ * \brief compile a list of dot paths
+ * \param paths the paths, must stay valid as long as the scanner is used
+ * \retval 0 on success, -1 if there are too many paths or levels
+ */
+int json_scan_compile(json_scan_s* scan, const char** paths, int count);
+
+/*!
+ * \brief scan a document once and fill the value of each path
+ * \param json the document, doesn't have to be null terminated
+ * \param len length of the document
+ * \param values array of scan->count values, type is JSON_SCAN_NONE for a path not found
+ * \retval number of paths found, -1 if the document is not valid JSON
+ */
+int json_scan(const json_scan_s* scan, const char* json, size_t len, json_scan_value_s* values);
+
+/*!
+ * \brief copy a string value to buf, decoding the escapes
+ * \retval length of the copy, -1 if the value is not a string or buf is too small
+ */
+int json_scan_get_string(const json_scan_value_s* value, char* buf, size_t size);
+
+/*!
+ * \brief get a number value, numbers in a string are accepted too
+ * \retval the number, 0 if the value is not a number
+ */
+double json_scan_get_number(const json_scan_value_s* value);
+
+#endif /* _LGW_JSONSCAN_H */
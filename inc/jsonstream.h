@@ -0,0 +1,84 @@
+/*
+ *  ____  ____      _    ____ ___ _   _  ___
+ *  |  _ \|  _ \    / \  / ___|_ _| \ | |/ _ \
+ *  | | | | |_) |  / _ \| |  _ | ||  \| | | | |
+ *  | |_| |  _ <  / ___ \ |_| || || |\  | |_| |
+ *  |____/|_| \_\/_/   \_\____|___|_| \_|\___/
+ *
+ * location service -- An opensource of lorawan location service
+ *
+ * See http://www.dragino.com for more information about
+ * the lora gateway project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ *
+ * Maintainer: skerlan
+ *
+ */
+
+/*! \file
+ *
+ * \brief incremental splitter of a JSON array
+ *
+ * A response which is one big JSON array (e.g. the mapwize beacon list) is
+ * fed chunk by chunk as it is received. Each element is handed to a callback
+ * as soon as its last byte arrives, then its bytes are dropped: only the
+ * element in progress is buffered, whatever the size of the array.
+ */
+
+#ifndef _LGW_JSONSTREAM_H
+#define _LGW_JSONSTREAM_H
+
+#include <stddef.h>
+
+#define JSON_STREAM_MAX_ELEMENT     (1 << 20)   /* bytes of one element */
+
+/*!
+ * \brief callback of a complete element
+ * \param elem the element, null terminated, may be modified (e.g. parsed in place), valid until the callback returns
+ * \retval 0 to go on, -1 to abort the stream
+ */
+typedef int (*json_stream_cb)(void* ctx, char* elem, size_t len);
+
+/*!
+ * \brief struct of a stream
+ */
+typedef struct {
+    int state;
+    int depth;                  /* nesting of the element in progress */
+    int in_string;
+    int escape;
+    char* buf;                  /* the element in progress */
+    size_t len;
+    size_t size;
+    size_t count;               /* elements handed to cb */
+    json_stream_cb cb;
+    void* ctx;
+} json_stream_s;
+
+/*!
+ * \brief initialize a stream
+ */
+void json_stream_init(json_stream_s* stream, json_stream_cb cb, void* ctx);
+
+/*!
+ * \brief feed the next chunk
+ * \retval 0 on success, -1 if the data is not a JSON array, an element is too big or the callback aborted
+ */
+int json_stream_feed(json_stream_s* stream, const char* data, size_t len);
+
+/*!
+ * \brief end of the data
+ * \retval number of elements, -1 if the array is not closed or the stream failed before
+ */
+int json_stream_end(json_stream_s* stream);
+
+/*!
+ * \brief free the buffer of a stream
+ */
+void json_stream_free(json_stream_s* stream);
+
+#endif /* _LGW_JSONSTREAM_H */
@@ -51,30 +51,57 @@ typedef enum {
 } loc_type_e;
 
 /*!
- * \brief struct of topic struct 
+ * \brief struct of topic struct, each subscribed topic has its own decoder and qos
  */
 typedef struct _topic_s {
     LGW_LIST_ENTRY(_topic_s) list;
     char* topic_id;
     char* topic;
+    serv_type_e type;
+    int qos;
 } topic_s;
 
 /*!
  * \brief struct of topic head
  */
-//LGW_LIST_HEAD_NOLOCK(topic_list, _topic_s); 
+LGW_LIST_HEAD_NOLOCK(topic_list, _topic_s); 
 
 
 /*!
  * \brief struct of mqtt payload
+ *
+ * The payload is handed over from the mqtt thread without a copy: content
+ * points into the buffer of msg (a MQTTAsync_message), is len bytes long and
+ * is not null terminated. The parser releases msg when it is done.
  */
-typedef struct _payload_s {
-    LGW_LIST_ENTRY(_payload_s) list;
+typedef struct {
     serv_type_e type;
     int len;
-    char* content;
+    const char* content;
+    void* msg;
 } payload_s;
 
+/*!
+ * \brief struct of mqtt connection, every connection feeds the same parser pool
+ */
+typedef struct {
+    void* client;           /* MQTTAsync handle */
+    char* clientid;
+    int index;
+    volatile int subscribed;
+    volatile int finished;
+    volatile int disc_finished;
+} mqtt_conn_s;
+
+/*!
+ * \brief struct of payload parser worker, owns one shard of the devices
+ */
+typedef struct {
+    pthread_t thrid;
+    int index;
+    lgw_ring_s ring;
+} parse_worker_s;
+
 /*!
  * \brief struct of ibeacon node payload
  */
@@ -88,31 +115,58 @@ typedef struct _inode_s {
     int minor;
     int rssi;
     float dist;
+    int nreads;
+    beacon_read_s* reads;           /* the other beacons of a raw frame, strongest first */
 } inode_s;
 
 /*!
- * \brief struct of 
+ * \brief struct of device node, holds the latest pending location of one device
+ */
+typedef struct _dnode_s {
+    LGW_LIST_ENTRY(_dnode_s) list;  /* link in the dirty list */
+    struct _dnode_s* hnext;         /* link in the hash bucket */
+    char* deveui;
+    inode_s* pending;               /* latest reading not yet published, NULL if clean */
+} dnode_s;
+
+/*!
+ * \brief request in flight of a place
+ */
+typedef enum {
+    PLACE_IDLE = 0,
+    PLACE_UPDATING,                 /* PUT of the document */
+    PLACE_CREATING,                 /* POST of the document */
+    PLACE_DELETING                  /* DELETE of the place */
+} place_stage_e;
+
+/*!
+ * \brief struct of the state of a place, what the reconciler compares
  */
 typedef struct {
+    int floor;
     double lat;
     double lon;
-    float alt;
-} gps_s;
+} place_state_s;
 
 /*!
- * \brief struct of 
+ * \brief struct of a place of a device, its desired state and the state mapwize acknowledged
  */
-typedef struct _ibeacon_s {
-    LGW_LIST_ENTRY(_ibeacon_s) list;
-    char* id;
-    char* venueid;
-    char* orgid;
-    char* uuid;
-    int major;
-    int minor;
-    int floor;
-    gps_s gps;
-} ibeacon_s;
+typedef struct _pnode_s {
+    struct _pnode_s* hnext;         /* link in the hash bucket */
+    struct _pnode_s* qnext;         /* link in the reconcile queue */
+    char place_id[25];
+    int queued;
+    place_stage_e stage;
+    int exists;                     /* mapwize holds the place, in the acked state */
+    int conflict;                   /* the last create found the place already there */
+    place_state_s acked;
+    int wanted;                     /* the device has a position, the desired state */
+    place_state_s desired;
+    place_state_s sending;          /* state of the request in flight */
+    char* doc;                      /* place document of the desired state */
+    uint64_t seen;                  /* ms of the last reading, or of the listing */
+    uint64_t retry;                 /* ms before which a failed place is not sent again */
+} pnode_s;
 
 /*!
  * \brief struct of 
@@ -126,6 +180,20 @@ typedef struct {
     char* keywork;
 } place_s;
 
+/*!
+ * \brief struct of device model, the devices whose dev_id matches pattern send frames of layout
+ */
+typedef struct _model_s {
+    LGW_LIST_ENTRY(_model_s) list;
+    char* pattern;                  /* shell wildcard, e.g. "lbt1-*" */
+    const beacon_layout_s* layout;  /* NULL -> payload_fields of the network server */
+} model_s;
+
+/*!
+ * \brief struct of model head
+ */
+LGW_LIST_HEAD_NOLOCK(model_list, _model_s);
+
 /*!
  * \brief struct of mqtt configure 
  */
@@ -143,6 +211,7 @@ typedef struct {
     char* password;
     char* topic;
     char* connection;
+    struct topic_list topic_list;
 
     //configure of mapwize server;
     char* apikey;
@@ -151,13 +220,29 @@ typedef struct {
     char* universesid;
     char* placetype;
     char* placetypeid;
+    int beacon_refresh;             /* seconds between two beacon list fetches, 0 -> only at startup */
+    char* snapshot;                 /* file of the last beacon list, "" -> none */
+    int window;                     /* place updates in flight */
+    int reconcile_ms;               /* period of the place reconciler, 0 -> at each reading */
+    int place_ttl;                  /* seconds without reading before the place of a device is deleted, 0 -> never */
 
     //configure of distance
     int rssirate;
     float rssidiv;
+
+    //configure of payload parser pool
+    int parse_workers;
+
+    //configure of mqtt connections
+    int connections;
+    char* shared_group;
+
+    //configure of payload decoders
+    const beacon_layout_s* layout;  /* devices without a model, NULL -> payload_fields */
+    struct model_list model_list;
 } loccfg_s;
 
-#define LOCCFG_INIT { TTN, iBEACON, NULL, 1833, NULL, 1, 1000, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, 45, 2.0 }
+#define LOCCFG_INIT { TTN, iBEACON, NULL, 1833, NULL, 1, 1000, NULL, NULL, NULL, NULL, LGW_LIST_HEAD_NOLOCK_INIT_VALUE, NULL, NULL, NULL, NULL, NULL, NULL, 600, NULL, 8, 1000, 0, 45, 2.0, 1, 1, NULL, NULL, LGW_LIST_HEAD_NOLOCK_INIT_VALUE }
 
 #endif       // _DR_LOCATION_H_
 
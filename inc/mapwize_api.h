@@ -28,47 +28,156 @@
 #ifndef _LGW_MAPWIZE_H
 #define _LGW_MAPWIZE_H
 
+#include <pthread.h>
+#include <curl/curl.h>
+
+#include "jsonstream.h"
+
+#define MAPWIZE_POOL_SIZE   4       /* idle handles kept by a client */
+#define MAPWIZE_MAX_WINDOW  64      /* requests in flight of a client */
+
 /*!
  * \brief struct of curl callback writedata 
  */
 typedef struct {
   	char* ptr;
   	size_t len;
+  	size_t size;
 } curlstr_s;
 
+/*!
+ * \brief callback of a completed asynchronous request
+ * \param res CURLcode of the transfer
+ * \param status HTTP status, 0 if no response
+ * \param body the response, null terminated, valid until the callback returns
+ */
+typedef void (*mapwize_done_cb)(void* ctx, int res, long status, const char* body, size_t len);
+
+/*!
+ * \brief struct of an asynchronous request in flight
+ */
+typedef struct _mapwize_req_s {
+    struct _mapwize_req_s* next;
+    CURL* curl;
+    curlstr_s resp;
+    mapwize_done_cb done;
+    void* ctx;
+    const char* what;
+    char errbuf[CURL_ERROR_SIZE];
+} mapwize_req_s;
+
+/*!
+ * \brief struct of a mapwize client
+ *
+ * Every request of a client goes through a pool of curl handles which share
+ * the DNS cache and the TLS sessions, an idle handle keeps its connection
+ * alive for the next request: a request to api.mapwize.io doesn't pay a DNS
+ * lookup, a TCP and a TLS handshake. The blocking requests may be sent by
+ * many threads.
+ *
+ * The asynchronous requests are submitted to a curl multi handle, up to
+ * window of them are in flight at once, multiplexed on one HTTP/2
+ * connection when the server speaks it. Only one thread submits them and
+ * runs the client, the callbacks are called from mapwize_client_run().
+ */
+typedef struct {
+    CURLSH* share;
+    pthread_mutex_t share_lock[CURL_LOCK_DATA_LAST];
+    pthread_mutex_t pool_lock;
+    CURL* pool[MAPWIZE_POOL_SIZE];  /* idle handles */
+    int idle;
+    struct curl_slist* json_headers;
+
+    CURLM* multi;
+    int window;                     /* requests in flight at most */
+    int inflight;
+    mapwize_req_s* reqs;            /* in flight */
+} mapwize_client_s;
+
 /*!
  * \brief initialize curl write data struct 
  */
 curlstr_s* init_curl_write_data();
 
+/*!
+ * \brief initialize a client, curl_global_init must have been called
+ * \param window asynchronous requests in flight at most, 1 to MAPWIZE_MAX_WINDOW
+ * \retval 0 on success, -1 on failure
+ */
+int mapwize_client_init(mapwize_client_s* client, int window);
+
+/*!
+ * \brief close the connections and free the handles of a client, no blocking request may be running;
+ * the asynchronous requests still in flight are dropped without calling back
+ */
+void mapwize_client_destroy(mapwize_client_s* client);
+
+/*!
+ * \brief move the asynchronous requests on, call back the completed ones, then wait for the network or fd
+ * \param fd another descriptor to wait for (e.g. an eventfd), -1 for none
+ * \param timeout in ms
+ * \retval 1 if fd is readable, 0 otherwise
+ */
+int mapwize_client_run(mapwize_client_s* client, int fd, int timeout);
+
+/*!
+ * \brief number of asynchronous requests in flight
+ */
+int mapwize_client_inflight(const mapwize_client_s* client);
+
 /*!
  * \brief allows you to sign in using your email and password
  */
-int mapwize_signin(char* apikey, char* email, char* passwd);
+int mapwize_signin(mapwize_client_s* client, char* apikey, char* email, char* passwd);
+
+/*!
+ * \brief get the placetypes of an organization into a curlstr_s
+ */
+int mapwize_get_placetype(mapwize_client_s* client, char* apikey, char* orgid, void* data);
+
+/*!
+ * \brief create a place from its JSON document
+ */
+int mapwize_create_place(mapwize_client_s* client, char* apikey, char* data);
+
+/*!
+ * \brief delete a place
+ */
+int mapwize_del_places(mapwize_client_s* client, char* apikey, char* placeid);
+
+/*!
+ * \brief submit the creation of a place, data is copied
+ * \retval 0 on success, 1 if the window is full, -1 on failure; done is called only on success
+ */
+int mapwize_create_place_async(mapwize_client_s* client, const char* apikey, const char* data, mapwize_done_cb done, void* ctx);
 
 /*!
- * \brief 
+ * \brief submit the update of a place, data is copied and replaces the place
+ * \retval 0 on success, 1 if the window is full, -1 on failure; done is called only on success, with 404 if the place doesn't exist
  */
-int mapwize_get_placetype(char* apikey, char* orgid, void* data);
+int mapwize_update_place_async(mapwize_client_s* client, const char* apikey, const char* placeid, const char* data, mapwize_done_cb done, void* ctx);
 
 /*!
- * \brief 
+ * \brief submit the deletion of a place
+ * \retval 0 on success, 1 if the window is full, -1 on failure; done is called only on success
  */
-int mapwize_create_place(char* apikey, char* data);
+int mapwize_del_places_async(mapwize_client_s* client, const char* apikey, const char* placeid, mapwize_done_cb done, void* ctx);
 
 /*!
- * \brief 
+ * \brief create a beacon from its JSON document
  */
-int mapwize_del_places(char* apikey, char* placeid);
+int mapwize_create_beacons(mapwize_client_s* client, char* apikey, char* data);
 
 /*!
- * \brief 
+ * \brief get the places of an organization, fed to stream as they are received
+ * \retval CURLE_OK if the whole list was received with a 2xx status, json_stream_end() tells whether it was a complete array
  */
-int mapwize_create_beacons(char* apikey, char* data);
+int mapwize_get_places(mapwize_client_s* client, char* apikey, char* orgid, json_stream_s* stream);
 
 /*!
- * \brief 
+ * \brief get the beacon list, fed to stream as it is received
+ * \retval CURLE_OK if the whole list was received with a 2xx status, json_stream_end() tells whether it was a complete array
  */
-int mapwize_get_beacons(char* apikey, void* writedata);
+int mapwize_get_beacons(mapwize_client_s* client, char* apikey, json_stream_s* stream);
 
 #endif
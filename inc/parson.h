@@ -35,6 +35,7 @@ extern "C"
 typedef struct json_object_t JSON_Object;
 typedef struct json_array_t  JSON_Array;
 typedef struct json_value_t  JSON_Value;
+typedef struct json_arena_t  JSON_Arena;
 
 enum json_value_type {
     JSONError   = -1,
@@ -74,6 +75,30 @@ JSON_Value * json_parse_string(const char *string);
     returns NULL in case of error */
 JSON_Value * json_parse_string_with_comments(const char *string);
 
+/*  Same as json_parse_string_with_comments, but reads at most len bytes of a
+    string which doesn't have to be null terminated, returns NULL in case of error */
+JSON_Value * json_parse_stringn_with_comments(const char *string, size_t len);
+
+/* Arena parsing
+   The values, names and strings of a tree parsed into an arena are bump allocated
+   from the blocks of the arena instead of one malloc each. Such a tree is read only:
+   don't json_value_free it or pass it to the set/remove/append functions,
+   json_arena_reset releases every tree of the arena at once and keeps the blocks
+   for the next parse. An arena must be used by one thread at a time. */
+JSON_Arena * json_arena_new(size_t block_size); /* 0 selects the default block size */
+void         json_arena_reset(JSON_Arena *arena);
+void         json_arena_free(JSON_Arena *arena);
+
+JSON_Value * json_parse_string_arena(const char *string, JSON_Arena *arena);
+JSON_Value * json_parse_stringn_with_comments_arena(const char *string, size_t len, JSON_Arena *arena);
+
+/* In situ parsing into an arena
+   Nothing is copied: names and strings are decoded in place and null terminated
+   inside string, the tree points into it. string is modified and must outlive the
+   tree; the _with_comments variant blanks the comments of string in place too. */
+JSON_Value * json_parse_string_insitu(char *string, JSON_Arena *arena);
+JSON_Value * json_parse_string_with_comments_insitu(char *string, JSON_Arena *arena);
+
 /* Serialization */
 size_t      json_serialization_size(const JSON_Value *value); /* returns 0 on fail */
 JSON_Status json_serialize_to_buffer(const JSON_Value *value, char *buf, size_t buf_size_in_bytes);
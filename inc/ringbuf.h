@@ -0,0 +1,111 @@
+/*
+ *  ____  ____      _    ____ ___ _   _  ___
+ *  |  _ \|  _ \    / \  / ___|_ _| \ | |/ _ \
+ *  | | | | |_) |  / _ \| |  _ | ||  \| | | | |
+ *  | |_| |  _ <  / ___ \ |_| || || |\  | |_| |
+ *  |____/|_| \_\/_/   \_\____|___|_| \_|\___/
+ *
+ * location service -- An opensource of lorawan location service
+ *
+ * See http://www.dragino.com for more information about
+ * the lora gateway project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ *
+ * Maintainer: skerlan
+ *
+ */
+
+/*! \file
+ *
+ * \brief bounded multi-producer / single-consumer ring buffer
+ *
+ * Producers (e.g. the mqtt receive thread) copy fixed size elements into
+ * the ring without taking a lock, the single consumer drains everything
+ * available in one pass. The consumer is only woken through the eventfd
+ * when it is actually asleep, so the fd can also be watched by an event loop.
+ */
+
+#ifndef _LGW_RINGBUF_H
+#define _LGW_RINGBUF_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*!
+ * \brief ring slot, the sequence number tells who owns the slot
+ */
+typedef struct {
+    size_t seq;
+    unsigned char data[];
+} ring_slot_s;
+
+/*!
+ * \brief struct of ring buffer
+ */
+typedef struct {
+    unsigned char* slots;       /* slot storage, count * slotsize bytes */
+    size_t mask;                /* count - 1, count is a power of two */
+    size_t elemsize;            /* size of one element */
+    size_t slotsize;            /* size of one slot (header + element, aligned) */
+    size_t head;                /* next position to claim, shared by producers */
+    size_t tail;                /* next position to drain, consumer only */
+    uint64_t pushed;            /* number of elements accepted */
+    uint64_t drops;             /* number of elements refused because the ring was full */
+    int sleeping;               /* 1 -> consumer is waiting on efd */
+    int efd;                    /* eventfd doorbell of the consumer */
+} lgw_ring_s;
+
+/*!
+ * \brief initialize a ring buffer
+ * \param ring the ring to initialize
+ * \param count number of slots, rounded up to a power of two
+ * \param elemsize size in bytes of one element
+ * \retval 0 on success, -1 on failure
+ */
+int lgw_ring_init(lgw_ring_s* ring, size_t count, size_t elemsize);
+
+/*!
+ * \brief release the storage of a ring buffer, pending elements are discarded
+ */
+void lgw_ring_destroy(lgw_ring_s* ring);
+
+/*!
+ * \brief copy one element into the ring, safe from any number of threads
+ * \retval 0 on success, -1 if the ring is full (the drop counter is increased)
+ */
+int lgw_ring_push(lgw_ring_s* ring, const void* elem);
+
+/*!
+ * \brief copy up to max elements out of the ring, consumer thread only
+ * \param out array of at least max elements
+ * \retval number of elements copied
+ */
+size_t lgw_ring_drain(lgw_ring_s* ring, void* out, size_t max);
+
+/*!
+ * \brief block the consumer until the ring is not empty, or timeout
+ * \param timeout the maximum time to wait, in milliseconds
+ * \retval 0 if there are elements to drain, -1 on timeout or signal
+ */
+int lgw_ring_wait(lgw_ring_s* ring, int timeout);
+
+/*!
+ * \brief wake up the consumer, e.g. on exit
+ */
+void lgw_ring_wakeup(lgw_ring_s* ring);
+
+/*!
+ * \brief number of elements waiting in the ring
+ */
+size_t lgw_ring_depth(lgw_ring_s* ring);
+
+/*!
+ * \brief number of elements dropped because the ring was full
+ */
+uint64_t lgw_ring_drops(lgw_ring_s* ring);
+
+#endif /* _LGW_RINGBUF_H */
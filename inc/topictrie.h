@@ -0,0 +1,86 @@
+/*
+ *  ____  ____      _    ____ ___ _   _  ___
+ *  |  _ \|  _ \    / \  / ___|_ _| \ | |/ _ \
+ *  | | | | |_) |  / _ \| |  _ | ||  \| | | | |
+ *  | |_| |  _ <  / ___ \ |_| || || |\  | |_| |
+ *  |____/|_| \_\/_/   \_\____|___|_| \_|\___/
+ *
+ * location service -- An opensource of lorawan location service
+ *
+ * See http://www.dragino.com for more information about
+ * the lora gateway project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ *
+ * Maintainer: skerlan
+ *
+ */
+
+/*! \file
+ *
+ * \brief precompiled trie of mqtt topic filters
+ *
+ * The subscribed filters (with + and # wildcards) are compiled once into a
+ * trie of topic levels. Children are keyed by the hash and length of their
+ * level name, so matching a topic walks one level at a time and only touches
+ * the bytes of a level when its hash already matched.
+ */
+
+#ifndef _LGW_TOPICTRIE_H
+#define _LGW_TOPICTRIE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*!
+ * \brief struct of trie node, one topic level
+ */
+typedef struct _trie_node_s {
+    uint32_t hash;                  /* hash of the level name */
+    size_t len;                     /* length of the level name */
+    char* name;
+    struct _trie_node_s* child;     /* first child with a plain level name */
+    struct _trie_node_s* next;      /* next sibling */
+    struct _trie_node_s* plus;      /* child for the '+' wildcard */
+    struct _trie_node_s* multi;     /* child for the '#' wildcard */
+    void* value;                    /* set when a filter ends on this level */
+} trie_node_s;
+
+/*!
+ * \brief struct of topic filter trie
+ */
+typedef struct {
+    trie_node_s root;
+    int count;                      /* number of filters */
+} lgw_trie_s;
+
+/*!
+ * \brief initialize an empty trie
+ */
+void lgw_trie_init(lgw_trie_s* trie);
+
+/*!
+ * \brief add a topic filter to the trie
+ * \param filter mqtt topic filter, may contain '+' and a trailing '#'
+ * \param value returned by lgw_trie_match for topics matching filter
+ * \retval 0 on success, -1 on invalid filter or allocation failure
+ */
+int lgw_trie_insert(lgw_trie_s* trie, const char* filter, void* value);
+
+/*!
+ * \brief find the filter matching a topic, plain levels win over '+', '+' over '#'
+ * \param topic the topic name, doesn't have to be null terminated
+ * \param len length of topic
+ * \retval value of the matching filter, NULL if none matches
+ */
+void* lgw_trie_match(const lgw_trie_s* trie, const char* topic, size_t len);
+
+/*!
+ * \brief free all the nodes of a trie, the values are not freed
+ */
+void lgw_trie_free(lgw_trie_s* trie);
+
+#endif /* _LGW_TOPICTRIE_H */
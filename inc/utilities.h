@@ -32,6 +32,7 @@
 #include <string.h>
 #include <pthread.h>
 #include <semaphore.h>
+#include <signal.h>
 
 #include "logger.h"
 #include "lgwmm.h"
@@ -129,6 +130,27 @@ void lgw_memset( uint8_t *dst, uint8_t value, uint16_t size );
  */
 char* lgw_gen_str(char* str, int size);
 
+/*!
+ * \brief FNV-1a hash of a string
+ *
+ * \param [IN] str  string, doesn't have to be null terminated
+ * \param [IN] len  number of bytes to hash
+ * \retval hash value
+ */
+uint32_t lgw_str_hash(const char* str, size_t len);
+
+/*!
+ * \brief format a double with a fixed number of decimals, without printf
+ *
+ * The last decimal may differ from printf("%.*f") for more than 15 significant digits.
+ *
+ * \param [IN] value  the number, must be finite and below 2^63
+ * \param [IN] prec   number of decimals, 0 to 15
+ * \param [OUT] buf   at least 21 + prec bytes, null terminated
+ * \retval length of the string
+ */
+int lgw_dtoa_fixed(double value, int prec, char* buf);
+
 /*!
  * \brief Converts a nibble to an hexadecimal character
  *
@@ -219,6 +241,98 @@ int lgw_get_tid(void);
  */
 int lgw_wait_sem(sem_t*, int);
 
+/*!
+ * \brief callback of an event source, called by lgw_evloop_run
+ * \param fd the file descriptor which is ready
+ * \param events the epoll events reported for fd
+ * \param data the pointer given to lgw_evloop_add
+ */
+typedef void (*lgw_ev_cb)(int fd, uint32_t events, void* data);
+
+/*!
+ * \brief struct of an event source registered in an event loop
+ */
+typedef struct {
+    int fd;
+    lgw_ev_cb cb;
+    void* data;
+} lgw_ev_s;
+
+/*!
+ * \brief struct of event loop, queues (eventfd), signals (signalfd) and
+ * periodic timers (timerfd) all wake up through the same epoll fd
+ */
+typedef struct {
+    int epfd;
+} lgw_evloop_s;
+
+/*!
+ * \brief Create the epoll instance of an event loop
+ * \return 0 on success, -1 on failure
+ */
+int lgw_evloop_init(lgw_evloop_s* loop);
+
+/*!
+ * \brief Close the epoll instance of an event loop, the sources have to be deleted first
+ */
+void lgw_evloop_destroy(lgw_evloop_s* loop);
+
+/*!
+ * \brief Register a file descriptor in an event loop
+ * \param events epoll events to wait for, typ. EPOLLIN
+ * \return the event source, NULL on failure
+ */
+lgw_ev_s* lgw_evloop_add(lgw_evloop_s* loop, int fd, uint32_t events, lgw_ev_cb cb, void* data);
+
+/*!
+ * \brief Unregister and free an event source, the fd is not closed
+ */
+void lgw_evloop_del(lgw_evloop_s* loop, lgw_ev_s* ev);
+
+/*!
+ * \brief Wait for events and call the callbacks of the ready sources
+ * \param timeout the maximum time to wait, in milliseconds, -1 for ever
+ * \return number of sources dispatched, 0 on timeout, -1 on error
+ */
+int lgw_evloop_run(lgw_evloop_s* loop, int timeout);
+
+/*!
+ * \brief Create a non blocking eventfd, used as a queue doorbell
+ * \return the fd, -1 on failure
+ */
+int lgw_eventfd_create(void);
+
+/*!
+ * \brief Ring the doorbell of an eventfd
+ */
+void lgw_eventfd_post(int fd);
+
+/*!
+ * \brief Reset an eventfd or timerfd
+ * \return the counter read from fd (posts or timer expirations), 0 if none
+ */
+uint64_t lgw_eventfd_take(int fd);
+
+/*!
+ * \brief Wait for an eventfd to be posted, or timeout, and reset it
+ * \param timeout the maximum time to wait, in milliseconds
+ * \return 0 if posted, -1 on timeout or error
+ */
+int lgw_eventfd_wait(int fd, int timeout);
+
+/*!
+ * \brief Create a non blocking periodic timerfd
+ * \param interval the period, in milliseconds
+ * \return the fd, -1 on failure
+ */
+int lgw_timerfd_create(int interval);
+
+/*!
+ * \brief Create a non blocking signalfd, the signals of mask must be blocked
+ * \return the fd, -1 on failure
+ */
+int lgw_signalfd_create(const sigset_t* mask);
+
 /*!
  * \brief Checks to see if value is within the given bounds
  *
@@ -20,6 +20,14 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #include <stdlib.h>
 #include <stdint.h>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define B64_X86
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define B64_NEON
+#endif
+
 #include "base64.h"
 
 /* -------------------------------------------------------------------------- */
@@ -34,61 +42,314 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE CONSTANTS ---------------------------------------------------- */
 
+/* RFC 1421 alphabet, '+' for code 62 and '/' for code 63 */
+static const char code_to_char[64] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/* code of each ASCII character, 0xFF for the characters out of the alphabet */
+static const uint8_t char_to_code[256] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x3E, 0xFF, 0xFF, 0xFF, 0x3F,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E,
+    0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30, 0x31, 0x32, 0x33, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MODULE-WIDE VARIABLES ---------------------------------------- */
 
-static char code_62 = '+';    /* RFC 1421 standard character for code 62 */
-static char code_63 = '/';    /* RFC 1421 standard character for code 63 */
 static char code_pad = '=';    /* RFC 1421 padding character if padding */
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
 
 /**
-@brief Convert a code in the range 0-63 to an ASCII character
+@brief Encode the size/3 full blocks of in, 4 characters for 3 bytes
+*/
+static void encode_blocks_scalar(const uint8_t * in, int size, char * out);
+
+/**
+@brief Decode blocks of 4 characters to 3 bytes
+@param max_len usable size of out, the vector kernels store a few bytes past the last block
+@return 0, -1 if a character is out of the alphabet
 */
-char code_to_char(uint8_t x);
+static int decode_blocks_scalar(const char * in, int blocks, uint8_t * out, int max_len);
 
 /**
-@brief Convert an ASCII character to a code in the range 0-63
+@brief Pick the encoding and decoding kernels for the running CPU
 */
-uint8_t char_to_code(char x);
+static void b64_init(void) __attribute__((constructor));
+
+/* kernels picked once at startup by b64_init */
+static void (*encode_blocks)(const uint8_t * in, int size, char * out) = encode_blocks_scalar;
+static int  (*decode_blocks)(const char * in, int blocks, uint8_t * out, int max_len) = decode_blocks_scalar;
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
 
-char code_to_char(uint8_t x) {
-    if (x <= 25) {
-        return 'A' + x;
-    } else if ((x >= 26) && (x <= 51)) {
-        return 'a' + (x-26);
-    } else if ((x >= 52) && (x <= 61)) {
-        return '0' + (x-52);
-    } else if (x == 62) {
-        return code_62;
-    } else if (x == 63) {
-        return code_63;
-    } else {
-        DEBUG("ERROR: %i IS OUT OF RANGE 0-63 FOR BASE64 ENCODING\n", x);
-        exit(EXIT_FAILURE);
-    } //TODO: improve error management
+static void encode_blocks_scalar(const uint8_t * in, int size, char * out) {
+    uint32_t b;
+
+    for (; size >= 3; size -= 3, in += 3, out += 4) {
+        b = ((uint32_t)in[0] << 16) | ((uint32_t)in[1] << 8) | in[2];
+        out[0] = code_to_char[(b >> 18) & 0x3F];
+        out[1] = code_to_char[(b >> 12) & 0x3F];
+        out[2] = code_to_char[(b >> 6 ) & 0x3F];
+        out[3] = code_to_char[ b        & 0x3F];
+    }
+}
+
+static int decode_blocks_scalar(const char * in, int blocks, uint8_t * out, int max_len) {
+    const uint8_t * s = (const uint8_t *)in;
+    uint32_t a, b, c, d;
+
+    (void)max_len;
+    for (; blocks > 0; --blocks, s += 4, out += 3) {
+        a = char_to_code[s[0]];
+        b = char_to_code[s[1]];
+        c = char_to_code[s[2]];
+        d = char_to_code[s[3]];
+        if ((a | b | c | d) & 0x80) {
+            DEBUG("ERROR: INVALID CHARACTER FOR BASE64 DECODING\n");
+            return -1;
+        }
+        b = (a << 18) | (b << 12) | (c << 6) | d;
+        out[0] = (b >> 16) & 0xFF;
+        out[1] = (b >> 8 ) & 0xFF;
+        out[2] =  b        & 0xFF;
+    }
+
+    return 0;
+}
+
+#if defined(B64_X86)
+/* The x86 kernels work on 32 bit lanes of 3 bytes / 4 codes, see
+ * W. Mula, D. Lemire, "Faster Base64 Encoding and Decoding Using AVX2 Instructions" */
+
+__attribute__((target("ssse3")))
+static inline __m128i encode_translate_ssse3(__m128i codes) {
+    /* offset from code to character, indexed by 0 for 'a'..'z', 1..10 for '0'..'9', 11 '+', 12 '/', 13 'A'..'Z' */
+    const __m128i shift = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    __m128i index = _mm_subs_epu8(codes, _mm_set1_epi8(51));
+    index = _mm_or_si128(index, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), codes), _mm_set1_epi8(13)));
+    return _mm_add_epi8(codes, _mm_shuffle_epi8(shift, index));
 }
 
-uint8_t char_to_code(char x) {
-    if ((x >= 'A') && (x <= 'Z')) {
-        return (uint8_t)x - (uint8_t)'A';
-    } else if ((x >= 'a') && (x <= 'z')) {
-        return (uint8_t)x - (uint8_t)'a' + 26;
-    } else if ((x >= '0') && (x <= '9')) {
-        return (uint8_t)x - (uint8_t)'0' + 52;
-    } else if (x == code_62) {
-        return 62;
-    } else if (x == code_63) {
-        return 63;
-    } else {
-        DEBUG("ERROR: %c (0x%x) IS INVALID CHARACTER FOR BASE64 DECODING\n", x, x);
-        exit(EXIT_FAILURE);
-    } //TODO: improve error management
+__attribute__((target("ssse3")))
+static inline __m128i encode_split_ssse3(__m128i block) {
+    /* bytes [b1 b0 b2 b1] in each lane, then the four 6 bit codes moved to their own byte */
+    block = _mm_shuffle_epi8(block, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+    return _mm_or_si128(_mm_mulhi_epu16(_mm_and_si128(block, _mm_set1_epi32(0x0FC0FC00)), _mm_set1_epi32(0x04000040)),
+                        _mm_mullo_epi16(_mm_and_si128(block, _mm_set1_epi32(0x003F03F0)), _mm_set1_epi32(0x01000010)));
+}
+
+/* the ssse3 kernels also finish the avx2 ones, inlined there to get the VEX encoding
+ * and no SSE/AVX transition penalty */
+__attribute__((target("ssse3"), always_inline))
+static inline void encode_blocks_ssse3(const uint8_t * in, int size, char * out) {
+    int i = 0;
+
+    /* 12 bytes used of each 16 bytes load */
+    for (; i + 16 <= size; i += 12, out += 16)
+        _mm_storeu_si128((__m128i *)out, encode_translate_ssse3(encode_split_ssse3(_mm_loadu_si128((const __m128i *)(in + i)))));
+
+    encode_blocks_scalar(in + i, size - i, out);
+}
+
+__attribute__((target("ssse3"), always_inline))
+static inline int decode_blocks_ssse3(const char * in, int blocks, uint8_t * out, int max_len) {
+    /* a character is valid when the bits of its low and high nibble classes don't intersect */
+    const __m128i class_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                           0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i class_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                           0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    /* offset from character to code, indexed by the high nibble, 1 for '/' */
+    const __m128i shift = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    __m128i block, hi, lo;
+    int i = 0;
+
+    for (; i + 4 <= blocks && 3 * i + 16 <= max_len; i += 4) {
+        block = _mm_loadu_si128((const __m128i *)(in + 4 * i));
+        hi = _mm_and_si128(_mm_srli_epi32(block, 4), nibble);
+        lo = _mm_and_si128(block, nibble);
+        if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(_mm_shuffle_epi8(class_lo, lo), _mm_shuffle_epi8(class_hi, hi)),
+                                             _mm_setzero_si128()))) {
+            DEBUG("ERROR: INVALID CHARACTER FOR BASE64 DECODING\n");
+            return -1;
+        }
+        block = _mm_add_epi8(block, _mm_shuffle_epi8(shift, _mm_add_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8('/')), hi)));
+        /* merge the four codes of a lane to 24 bits, then pack the 12 bytes */
+        block = _mm_madd_epi16(_mm_maddubs_epi16(block, _mm_set1_epi32(0x01400140)), _mm_set1_epi32(0x00011000));
+        block = _mm_shuffle_epi8(block, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+        _mm_storeu_si128((__m128i *)(out + 3 * i), block);
+    }
+
+    return decode_blocks_scalar(in + 4 * i, blocks - i, out + 3 * i, max_len - 3 * i);
+}
+
+__attribute__((target("avx2")))
+static void encode_blocks_avx2(const uint8_t * in, int size, char * out) {
+    const __m256i spread = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                            1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    const __m256i shift = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                           '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+                                           'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                           '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    __m256i block, index;
+    int i = 0;
+
+    /* 12 bytes in each 128 bit lane */
+    for (; i + 28 <= size; i += 24, out += 32) {
+        block = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(in + i))),
+                                        _mm_loadu_si128((const __m128i *)(in + i + 12)), 1);
+        block = _mm256_shuffle_epi8(block, spread);
+        block = _mm256_or_si256(_mm256_mulhi_epu16(_mm256_and_si256(block, _mm256_set1_epi32(0x0FC0FC00)), _mm256_set1_epi32(0x04000040)),
+                                _mm256_mullo_epi16(_mm256_and_si256(block, _mm256_set1_epi32(0x003F03F0)), _mm256_set1_epi32(0x01000010)));
+        index = _mm256_subs_epu8(block, _mm256_set1_epi8(51));
+        index = _mm256_or_si256(index, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), block), _mm256_set1_epi8(13)));
+        _mm256_storeu_si256((__m256i *)out, _mm256_add_epi8(block, _mm256_shuffle_epi8(shift, index)));
+    }
+
+    encode_blocks_ssse3(in + i, size - i, out);
+}
+
+__attribute__((target("avx2")))
+static int decode_blocks_avx2(const char * in, int blocks, uint8_t * out, int max_len) {
+    const __m256i class_lo = _mm256_broadcastsi128_si256(_mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                                                       0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A));
+    const __m256i class_hi = _mm256_broadcastsi128_si256(_mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                                                       0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10));
+    const __m256i shift = _mm256_broadcastsi128_si256(_mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0));
+    const __m256i pack = _mm256_broadcastsi128_si256(_mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    __m256i block, hi, lo;
+    int i = 0;
+
+    for (; i + 8 <= blocks && 3 * i + 32 <= max_len; i += 8) {
+        block = _mm256_loadu_si256((const __m256i *)(in + 4 * i));
+        hi = _mm256_and_si256(_mm256_srli_epi32(block, 4), nibble);
+        lo = _mm256_and_si256(block, nibble);
+        if (_mm256_movemask_epi8(_mm256_cmpgt_epi8(_mm256_and_si256(_mm256_shuffle_epi8(class_lo, lo), _mm256_shuffle_epi8(class_hi, hi)),
+                                                   _mm256_setzero_si256()))) {
+            DEBUG("ERROR: INVALID CHARACTER FOR BASE64 DECODING\n");
+            return -1;
+        }
+        block = _mm256_add_epi8(block, _mm256_shuffle_epi8(shift, _mm256_add_epi8(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('/')), hi)));
+        block = _mm256_madd_epi16(_mm256_maddubs_epi16(block, _mm256_set1_epi32(0x01400140)), _mm256_set1_epi32(0x00011000));
+        /* 12 bytes at the bottom of each lane, then the two lanes joined */
+        block = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(block, pack), _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+        _mm256_storeu_si256((__m256i *)(out + 3 * i), block);
+    }
+
+    return decode_blocks_ssse3(in + 4 * i, blocks - i, out + 3 * i, max_len - 3 * i);
+}
+#endif
+
+#if defined(B64_NEON)
+/* the NEON kernels de-interleave 16 blocks with vld3/vld4, one vector per byte or code of a block */
+
+static inline int neon_any(uint8x16_t v) {
+    return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(v), 4)), 0) != 0;
+}
+
+static inline uint8x16_t neon_encode(uint8x16_t codes) {
+    uint8x16_t shift = vdupq_n_u8('A');
+    shift = vbslq_u8(vcgeq_u8(codes, vdupq_n_u8(26)), vdupq_n_u8('a' - 26), shift);
+    shift = vbslq_u8(vcgeq_u8(codes, vdupq_n_u8(52)), vdupq_n_u8((uint8_t)('0' - 52)), shift);
+    shift = vbslq_u8(vceqq_u8(codes, vdupq_n_u8(62)), vdupq_n_u8((uint8_t)('+' - 62)), shift);
+    shift = vbslq_u8(vceqq_u8(codes, vdupq_n_u8(63)), vdupq_n_u8((uint8_t)('/' - 63)), shift);
+    return vaddq_u8(codes, shift);
+}
+
+/* the ranges are disjoint, valid keeps the characters found in one of them */
+static inline uint8x16_t neon_decode(uint8x16_t chars, uint8x16_t * valid) {
+    uint8x16_t upper = vandq_u8(vcgeq_u8(chars, vdupq_n_u8('A')), vcleq_u8(chars, vdupq_n_u8('Z')));
+    uint8x16_t lower = vandq_u8(vcgeq_u8(chars, vdupq_n_u8('a')), vcleq_u8(chars, vdupq_n_u8('z')));
+    uint8x16_t digit = vandq_u8(vcgeq_u8(chars, vdupq_n_u8('0')), vcleq_u8(chars, vdupq_n_u8('9')));
+    uint8x16_t plus = vceqq_u8(chars, vdupq_n_u8('+'));
+    uint8x16_t slash = vceqq_u8(chars, vdupq_n_u8('/'));
+    uint8x16_t shift;
+
+    shift = vandq_u8(upper, vdupq_n_u8((uint8_t)-65));
+    shift = vorrq_u8(shift, vandq_u8(lower, vdupq_n_u8((uint8_t)-71)));
+    shift = vorrq_u8(shift, vandq_u8(digit, vdupq_n_u8(4)));
+    shift = vorrq_u8(shift, vandq_u8(plus, vdupq_n_u8(19)));
+    shift = vorrq_u8(shift, vandq_u8(slash, vdupq_n_u8(16)));
+    *valid = vandq_u8(*valid, vorrq_u8(vorrq_u8(upper, lower), vorrq_u8(digit, vorrq_u8(plus, slash))));
+
+    return vaddq_u8(chars, shift);
+}
+
+static void encode_blocks_neon(const uint8_t * in, int size, char * out) {
+    uint8x16x3_t bytes;
+    uint8x16x4_t chars;
+    int i = 0;
+
+    for (; i + 48 <= size; i += 48, out += 64) {
+        bytes = vld3q_u8(in + i);
+        chars.val[0] = neon_encode(vshrq_n_u8(bytes.val[0], 2));
+        chars.val[1] = neon_encode(vorrq_u8(vandq_u8(vshlq_n_u8(bytes.val[0], 4), vdupq_n_u8(0x30)), vshrq_n_u8(bytes.val[1], 4)));
+        chars.val[2] = neon_encode(vorrq_u8(vandq_u8(vshlq_n_u8(bytes.val[1], 2), vdupq_n_u8(0x3C)), vshrq_n_u8(bytes.val[2], 6)));
+        chars.val[3] = neon_encode(vandq_u8(bytes.val[2], vdupq_n_u8(0x3F)));
+        vst4q_u8((uint8_t *)out, chars);
+    }
+
+    encode_blocks_scalar(in + i, size - i, out);
+}
+
+static int decode_blocks_neon(const char * in, int blocks, uint8_t * out, int max_len) {
+    uint8x16x4_t chars;
+    uint8x16x3_t bytes;
+    uint8x16_t a, b, c, d, valid;
+    int i = 0;
+
+    for (; i + 16 <= blocks; i += 16) {
+        chars = vld4q_u8((const uint8_t *)in + 4 * i);
+        valid = vdupq_n_u8(0xFF);
+        a = neon_decode(chars.val[0], &valid);
+        b = neon_decode(chars.val[1], &valid);
+        c = neon_decode(chars.val[2], &valid);
+        d = neon_decode(chars.val[3], &valid);
+        if (neon_any(vmvnq_u8(valid))) {
+            DEBUG("ERROR: INVALID CHARACTER FOR BASE64 DECODING\n");
+            return -1;
+        }
+        bytes.val[0] = vorrq_u8(vshlq_n_u8(a, 2), vshrq_n_u8(b, 4));
+        bytes.val[1] = vorrq_u8(vshlq_n_u8(b, 4), vshrq_n_u8(c, 2));
+        bytes.val[2] = vorrq_u8(vshlq_n_u8(c, 6), d);
+        vst3q_u8(out + 3 * i, bytes);
+    }
+
+    return decode_blocks_scalar(in + 4 * i, blocks - i, out + 3 * i, max_len - 3 * i);
+}
+#endif
+
+static void b64_init(void) {
+#if defined(B64_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        encode_blocks = encode_blocks_avx2;
+        decode_blocks = decode_blocks_avx2;
+    } else if (__builtin_cpu_supports("ssse3")) {
+        encode_blocks = encode_blocks_ssse3;
+        decode_blocks = decode_blocks_ssse3;
+    }
+#elif defined(B64_NEON)
+    encode_blocks = encode_blocks_neon;
+    decode_blocks = decode_blocks_neon;
+#endif
 }
 
 /* -------------------------------------------------------------------------- */
@@ -137,15 +398,7 @@ int bin_to_b64_nopad(const uint8_t * in, int size, char * out, int max_len) {
     }
 
     /* process all the full blocks */
-    for (i=0; i < full_blocks; ++i) {
-        b  = (0xFF & in[3*i]    ) << 16;
-        b |= (0xFF & in[3*i + 1]) << 8;
-        b |=  0xFF & in[3*i + 2];
-        out[4*i + 0] = code_to_char((b >> 18) & 0x3F);
-        out[4*i + 1] = code_to_char((b >> 12) & 0x3F);
-        out[4*i + 2] = code_to_char((b >> 6 ) & 0x3F);
-        out[4*i + 3] = code_to_char( b        & 0x3F);
-    }
+    encode_blocks(in, 3*full_blocks, out);
 
     /* process the last 'partial' block and terminate string */
     i = full_blocks;
@@ -153,15 +406,15 @@ int bin_to_b64_nopad(const uint8_t * in, int size, char * out, int max_len) {
         out[4*i] =  0; /* null character to terminate string */
     } else if (last_chars == 2) {
         b  = (0xFF & in[3*i]    ) << 16;
-        out[4*i + 0] = code_to_char((b >> 18) & 0x3F);
-        out[4*i + 1] = code_to_char((b >> 12) & 0x3F);
+        out[4*i + 0] = code_to_char[(b >> 18) & 0x3F];
+        out[4*i + 1] = code_to_char[(b >> 12) & 0x3F];
         out[4*i + 2] =  0; /* null character to terminate string */
     } else if (last_chars == 3) {
         b  = (0xFF & in[3*i]    ) << 16;
         b |= (0xFF & in[3*i + 1]) << 8;
-        out[4*i + 0] = code_to_char((b >> 18) & 0x3F);
-        out[4*i + 1] = code_to_char((b >> 12) & 0x3F);
-        out[4*i + 2] = code_to_char((b >> 6 ) & 0x3F);
+        out[4*i + 0] = code_to_char[(b >> 18) & 0x3F];
+        out[4*i + 1] = code_to_char[(b >> 12) & 0x3F];
+        out[4*i + 2] = code_to_char[(b >> 6 ) & 0x3F];
         out[4*i + 3] = 0; /* null character to terminate string */
     }
 
@@ -174,8 +427,7 @@ int b64_to_bin_nopad(const char * in, int size, uint8_t * out, int max_len) {
     int full_blocks; /* number of 3 unsigned chars / 4 characters blocks */
     int last_chars; /* number of characters <4 in the last block */
     int last_bytes; /* number of unsigned chars <3 in the last block */
-    uint32_t b;
-    ;
+    uint32_t b, c0, c1, c2;
 
     /* check input values */
     if ((out == NULL) || (in == NULL)) {
@@ -214,34 +466,32 @@ int b64_to_bin_nopad(const char * in, int size, uint8_t * out, int max_len) {
     }
 
     /* process all the full blocks */
-    for (i=0; i < full_blocks; ++i) {
-        b  = (0x3F & char_to_code(in[4*i]    )) << 18;
-        b |= (0x3F & char_to_code(in[4*i + 1])) << 12;
-        b |= (0x3F & char_to_code(in[4*i + 2])) << 6;
-        b |=  0x3F & char_to_code(in[4*i + 3]);
-        out[3*i + 0] = (b >> 16) & 0xFF;
-        out[3*i + 1] = (b >> 8 ) & 0xFF;
-        out[3*i + 2] =  b        & 0xFF;
+    if (decode_blocks(in, full_blocks, out, max_len) != 0) {
+        return -1;
     }
 
-    /* process the last 'partial' block */
+    /* process the last 'partial' block, strict: the unusable bits must be zero */
     i = full_blocks;
     if (last_bytes == 1) {
-        b  = (0x3F & char_to_code(in[4*i]    )) << 18;
-        b |= (0x3F & char_to_code(in[4*i + 1])) << 12;
-        out[3*i + 0] = (b >> 16) & 0xFF;
-        if (((b >> 12) & 0x0F) != 0) {
-            DEBUG("WARNING: last character contains unusable bits\n");
+        c0 = char_to_code[(uint8_t)in[4*i]    ];
+        c1 = char_to_code[(uint8_t)in[4*i + 1]];
+        if (((c0 | c1) & 0x80) || (c1 & 0x0F) != 0) {
+            DEBUG("ERROR: INVALID LAST BLOCK IN B64_TO_BIN\n");
+            return -1;
         }
+        b = (c0 << 18) | (c1 << 12);
+        out[3*i + 0] = (b >> 16) & 0xFF;
     } else if (last_bytes == 2) {
-        b  = (0x3F & char_to_code(in[4*i]    )) << 18;
-        b |= (0x3F & char_to_code(in[4*i + 1])) << 12;
-        b |= (0x3F & char_to_code(in[4*i + 2])) << 6;
+        c0 = char_to_code[(uint8_t)in[4*i]    ];
+        c1 = char_to_code[(uint8_t)in[4*i + 1]];
+        c2 = char_to_code[(uint8_t)in[4*i + 2]];
+        if (((c0 | c1 | c2) & 0x80) || (c2 & 0x03) != 0) {
+            DEBUG("ERROR: INVALID LAST BLOCK IN B64_TO_BIN\n");
+            return -1;
+        }
+        b = (c0 << 18) | (c1 << 12) | (c2 << 6);
         out[3*i + 0] = (b >> 16) & 0xFF;
         out[3*i + 1] = (b >> 8 ) & 0xFF;
-        if (((b >> 6) & 0x03) != 0) {
-            DEBUG("WARNING: last character contains unusable bits\n");
-        }
     }
 
     return result_len;
@@ -291,7 +541,7 @@ int b64_to_bin(const char * in, int size, uint8_t * out, int max_len) {
         return -1;
     }
     if ((size%4 == 0) && (size >= 4)) { /* potentially padded Base64 */
-        if (in[size-2] == code_pad) { /* 2 padding char to ignore */
+        if ((in[size-2] == code_pad) && (in[size-1] == code_pad)) { /* 2 padding char to ignore */
             return b64_to_bin_nopad(in, size-2, out, max_len);
         } else if (in[size-1] == code_pad) { /* 1 padding char to ignore */
             return b64_to_bin_nopad(in, size-1, out, max_len);
@@ -0,0 +1,94 @@
+/*
+ *  ____  ____      _    ____ ___ _   _  ___
+ *  |  _ \|  _ \    / \  / ___|_ _| \ | |/ _ \
+ *  | | | | |_) |  / _ \| |  _ | ||  \| | | | |
+ *  | |_| |  _ <  / ___ \ |_| || || |\  | |_| |
+ *  |____/|_| \_\/_/   \_\____|___|_| \_|\___/
+ *
+ * location service -- An opensource of lorawan location service
+ *
+ * See http://www.dragino.com for more information about
+ * the lora gateway project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ *
+ * Maintainer: skerlan
+ *
+ */
+
+/*! \file
+ *
+ * \brief binary iBeacon frame decoder
+ *
+ */
+
+#include <string.h>
+#include <strings.h>
+
+#include "beacondec.h"
+
+/*
+ * "ibeacon":       uuid(16) major(2) minor(2) txpower(1) rssi(1), the full advertisement
+ * "ibeacon_short": uuid tail(6) major(2) minor(2) rssi(1), only what matching needs
+ */
+static const beacon_layout_s beacon_layouts[] = {
+    { "ibeacon",       0, 22, 10, 16, 18, 21 },
+    { "ibeacon_short", 0, 11,  0,  6,  8, 10 },
+};
+
+const beacon_layout_s* beacon_layout_find(const char* name)
+{
+    size_t i;
+
+    if (name == NULL)
+        return NULL;
+
+    for (i = 0; i < sizeof(beacon_layouts) / sizeof(beacon_layouts[0]); i++) {
+        if (!strcasecmp(beacon_layouts[i].name, name))
+            return &beacon_layouts[i];
+    }
+
+    return NULL;
+}
+
+int beacon_decode_frame(const beacon_layout_s* layout, const uint8_t* frame, int len, beacon_read_s* reads, int max)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    const uint8_t* rec;
+    beacon_read_s read;
+    int i, j, count, n = 0;
+
+    if (len < layout->header || (len - layout->header) % layout->record)
+        return -1;
+
+    count = (len - layout->header) / layout->record;
+
+    for (i = 0; i < count; i++) {
+        rec = frame + layout->header + i * layout->record;
+
+        for (j = 0; j < BEACON_UUID_TAIL / 2; j++) {
+            read.uuid[2 * j] = hex[rec[layout->uuid_off + j] >> 4];
+            read.uuid[2 * j + 1] = hex[rec[layout->uuid_off + j] & 0x0F];
+        }
+        read.uuid[BEACON_UUID_TAIL] = '\0';
+        read.major = (rec[layout->major_off] << 8) | rec[layout->major_off + 1];
+        read.minor = (rec[layout->minor_off] << 8) | rec[layout->minor_off + 1];
+        read.rssi = (int8_t)rec[layout->rssi_off];
+
+        /* insertion by rssi, keep the max strongest */
+        for (j = n; j > 0 && reads[j - 1].rssi < read.rssi; j--) {
+            if (j < max)
+                reads[j] = reads[j - 1];
+        }
+        if (j < max) {
+            reads[j] = read;
+            if (n < max)
+                n++;
+        }
+    }
+
+    return n;
+}
@@ -0,0 +1,605 @@
+/*
+ *  ____  ____      _    ____ ___ _   _  ___
+ *  |  _ \|  _ \    / \  / ___|_ _| \ | |/ _ \
+ *  | | | | |_) |  / _ \| |  _ | ||  \| | | | |
+ *  | |_| |  _ <  / ___ \ |_| || || |\  | |_| |
+ *  |____/|_| \_\/_/   \_\____|___|_| \_|\___/
+ *
+ * location service -- An opensource of lorawan location service
+ *
+ * See http://www.dragino.com for more information about
+ * the lora gateway project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ *
+ * Maintainer: skerlan
+ *
+ */
+
+/*! \file
+ *
+ * \brief registry of the mapwize beacons
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "utilities.h"
+#include "beacondec.h"
+#include "beaconreg.h"
+
+#define BEACON_REG_MIN_SLOTS    64
+#define BEACON_REG_MIN_ROWS     32
+#define BEACON_REG_MIN_POOL     1024
+#define BEACON_STR_NONE         0xFFFFFFFFu
+
+#define BEACON_SNAP_MAGIC       "LOCBREG"
+#define BEACON_SNAP_VERSION     1
+#define BEACON_SNAP_ORDER       0x01020304u
+#define BEACON_SNAP_ALIGN(x)    (((x) + 7) & ~(uint64_t)7)
+
+/*!
+ * \brief header of a snapshot file, the sections follow, each 8 bytes aligned:
+ * the columns in snap_columns order, the key index, the pool and the tags
+ */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t order;             /* BEACON_SNAP_ORDER in the byte order of the writer */
+    uint32_t key_size;          /* sizeof(beacon_key_s) of the writer */
+    uint32_t count;             /* rows */
+    uint32_t slots;             /* slots of the key index */
+    uint32_t pool_len;
+    uint32_t ntags;
+    uint32_t tags_len;          /* the tags, null terminated one after the other */
+    uint32_t checksum;          /* of the sections */
+    uint32_t reserved;
+    uint64_t size;              /* of the whole file */
+} beacon_snap_hdr_s;
+
+/* columns of a snapshot, in file order */
+static const struct {
+    size_t field;               /* offset of the column pointer in beacon_reg_s */
+    size_t size;                /* size of one element */
+} snap_columns[] = {
+    { offsetof(beacon_reg_s, key),              sizeof(beacon_key_s) },
+    { offsetof(beacon_reg_s, lat),              sizeof(double) },
+    { offsetof(beacon_reg_s, lon),              sizeof(double) },
+    { offsetof(beacon_reg_s, floor),            sizeof(int32_t) },
+    { offsetof(beacon_reg_s, id),               sizeof(uint32_t) },
+    { offsetof(beacon_reg_s, venueid),          sizeof(uint32_t) },
+    { offsetof(beacon_reg_s, orgid),            sizeof(uint32_t) },
+    { offsetof(beacon_reg_s, place_tail),       sizeof(uint32_t) },
+    { offsetof(beacon_reg_s, place_tail_len),   sizeof(uint32_t) }
+};
+
+#define SNAP_COLUMNS            (sizeof(snap_columns) / sizeof(snap_columns[0]))
+#define SNAP_SECTIONS           (SNAP_COLUMNS + 3)     /* + key index, pool, tags */
+#define SNAP_COLUMN(reg, i)     (*(void**)((char*)(reg) + snap_columns[i].field))
+
+static int hex_value(char ch)
+{
+    if (ch >= '0' && ch <= '9')
+        return ch - '0';
+    if (ch >= 'a' && ch <= 'f')
+        return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F')
+        return ch - 'A' + 10;
+    return -1;
+}
+
+static uint32_t beacon_key_hash(const beacon_key_s* key)
+{
+    uint64_t h = key->uuid_major ^ ((uint64_t)key->minor << 48) ^ key->minor;
+
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+
+    return (uint32_t)h;
+}
+
+static int beacon_key_equal(const beacon_key_s* a, const beacon_key_s* b)
+{
+    return a->uuid_major == b->uuid_major && a->minor == b->minor;
+}
+
+int beacon_key_make(beacon_key_s* key, const char* uuid, int major, int minor)
+{
+    uint64_t tail = 0;
+    int i, h;
+
+    if (uuid == NULL || major < 0 || major > 0xFFFF || minor < 0 || minor > 0xFFFF)
+        return -1;
+
+    for (i = 0; i < BEACON_UUID_TAIL; i++) {
+        if ((h = hex_value(uuid[i])) < 0)
+            return -1;
+        tail = (tail << 4) | h;
+    }
+
+    key->uuid_major = (tail << 16) | (uint64_t)major;
+    key->minor = (uint16_t)minor;
+
+    return 0;
+}
+
+void beacon_reg_init(beacon_reg_s* reg)
+{
+    memset(reg, 0, sizeof(beacon_reg_s));
+}
+
+/* resize one column, the column is left as is on failure */
+static int grow_column(void** column, size_t size)
+{
+    void* ptr = lgw_realloc(*column, size);
+
+    if (ptr == NULL)
+        return -1;
+    *column = ptr;
+    return 0;
+}
+
+static int grow_rows(beacon_reg_s* reg)
+{
+    size_t rows = reg->capacity ? (size_t)reg->capacity * 2 : BEACON_REG_MIN_ROWS;
+
+    if (grow_column((void**)&reg->key, rows * sizeof(beacon_key_s)) ||
+            grow_column((void**)&reg->floor, rows * sizeof(int32_t)) ||
+            grow_column((void**)&reg->lat, rows * sizeof(double)) ||
+            grow_column((void**)&reg->lon, rows * sizeof(double)) ||
+            grow_column((void**)&reg->id, rows * sizeof(uint32_t)) ||
+            grow_column((void**)&reg->venueid, rows * sizeof(uint32_t)) ||
+            grow_column((void**)&reg->orgid, rows * sizeof(uint32_t)) ||
+            grow_column((void**)&reg->place_tail, rows * sizeof(uint32_t)) ||
+            grow_column((void**)&reg->place_tail_len, rows * sizeof(uint32_t)))
+        return -1;
+
+    reg->capacity = (int)rows;
+
+    return 0;
+}
+
+/* the slots must be free of row, no check for duplicates */
+static void place_row(const beacon_reg_s* reg, uint32_t* slot, uint32_t mask, int row)
+{
+    uint32_t i = beacon_key_hash(&reg->key[row]) & mask;
+
+    while (slot[i] != 0)
+        i = (i + 1) & mask;
+
+    slot[i] = (uint32_t)row + 1;
+}
+
+static int grow_slots(beacon_reg_s* reg)
+{
+    uint32_t* slot;
+    uint32_t size;
+    int row;
+
+    size = reg->slot ? (reg->mask + 1) * 2 : BEACON_REG_MIN_SLOTS;
+    slot = (uint32_t*)lgw_malloc(size * sizeof(uint32_t));
+    if (slot == NULL)
+        return -1;
+
+    for (row = 0; row < reg->count; row++)
+        place_row(reg, slot, size - 1, row);
+
+    lgw_free(reg->slot);
+    reg->slot = slot;
+    reg->mask = size - 1;
+
+    return 0;
+}
+
+/* copy a string at the end of the pool, retval its offset */
+static uint32_t pool_append(beacon_reg_s* reg, const char* str, size_t len)
+{
+    uint32_t size = reg->pool_size ? reg->pool_size : BEACON_REG_MIN_POOL;
+    uint32_t offset;
+
+    if ((uint64_t)reg->pool_len + len + 1 > BEACON_STR_NONE / 2)
+        return BEACON_STR_NONE;
+
+    while (reg->pool_len + len + 1 > size)
+        size *= 2;
+    if (size != reg->pool_size) {
+        if (grow_column((void**)&reg->pool, size))
+            return BEACON_STR_NONE;
+        reg->pool_size = size;
+    }
+
+    offset = reg->pool_len;
+    memcpy(reg->pool + offset, str, len);
+    reg->pool[offset + len] = '\0';
+    reg->pool_len += len + 1;
+
+    return offset;
+}
+
+static void place_str(const beacon_reg_s* reg, uint32_t* slot, uint32_t mask, uint32_t offset)
+{
+    const char* str = reg->pool + offset;
+    uint32_t i = lgw_str_hash(str, strlen(str)) & mask;
+
+    while (slot[i] != 0)
+        i = (i + 1) & mask;
+
+    slot[i] = offset + 1;
+}
+
+static int grow_str_slots(beacon_reg_s* reg)
+{
+    uint32_t* slot;
+    uint32_t size, i;
+
+    size = reg->str_slot ? (reg->str_mask + 1) * 2 : BEACON_REG_MIN_SLOTS;
+    slot = (uint32_t*)lgw_malloc(size * sizeof(uint32_t));
+    if (slot == NULL)
+        return -1;
+
+    for (i = 0; reg->str_slot != NULL && i <= reg->str_mask; i++) {
+        if (reg->str_slot[i] != 0)
+            place_str(reg, slot, size - 1, reg->str_slot[i] - 1);
+    }
+
+    lgw_free(reg->str_slot);
+    reg->str_slot = slot;
+    reg->str_mask = size - 1;
+
+    return 0;
+}
+
+/* offset of the pooled copy of str, the same for equal strings */
+static uint32_t pool_intern(beacon_reg_s* reg, const char* str)
+{
+    size_t len = strlen(str);
+    uint32_t hash = lgw_str_hash(str, len);
+    uint32_t i, offset;
+
+    if ((reg->str_slot == NULL || (uint32_t)(reg->str_count + 1) * 2 > reg->str_mask + 1) && grow_str_slots(reg))
+        return BEACON_STR_NONE;
+
+    for (i = hash & reg->str_mask; reg->str_slot[i] != 0; i = (i + 1) & reg->str_mask) {
+        offset = reg->str_slot[i] - 1;
+        if (!memcmp(reg->pool + offset, str, len + 1))
+            return offset;
+    }
+
+    if ((offset = pool_append(reg, str, len)) == BEACON_STR_NONE)
+        return BEACON_STR_NONE;
+
+    reg->str_slot[i] = offset + 1;
+    reg->str_count++;
+
+    return offset;
+}
+
+int beacon_reg_add(beacon_reg_s* reg, const beacon_key_s* key, const beacon_info_s* info, int* row)
+{
+    uint32_t id, venueid, orgid, tail;
+    int found, n;
+
+    if (reg->map != NULL)
+        return -1;
+
+    if ((found = beacon_reg_find(reg, key)) >= 0) {
+        if (row != NULL)
+            *row = found;
+        return 1;
+    }
+
+    if (reg->count == reg->capacity && grow_rows(reg))
+        return -1;
+
+    if ((uint32_t)(reg->count + 1) * 2 > (reg->slot ? reg->mask + 1 : 0) && grow_slots(reg))
+        return -1;
+
+    /* a string pooled before a failure is only wasted, the pool is freed at once */
+    if ((id = pool_append(reg, info->id, strlen(info->id))) == BEACON_STR_NONE ||
+            (venueid = pool_intern(reg, info->venueid)) == BEACON_STR_NONE ||
+            (orgid = pool_intern(reg, info->orgid)) == BEACON_STR_NONE ||
+            (tail = pool_append(reg, info->place_tail, info->place_tail_len)) == BEACON_STR_NONE)
+        return -1;
+
+    n = reg->count;
+    memset(&reg->key[n], 0, sizeof(beacon_key_s));     // no garbage in the padding, the column is saved as is
+    reg->key[n].uuid_major = key->uuid_major;
+    reg->key[n].minor = key->minor;
+    reg->floor[n] = info->floor;
+    reg->lat[n] = info->lat;
+    reg->lon[n] = info->lon;
+    reg->id[n] = id;
+    reg->venueid[n] = venueid;
+    reg->orgid[n] = orgid;
+    reg->place_tail[n] = tail;
+    reg->place_tail_len[n] = (uint32_t)info->place_tail_len;
+
+    place_row(reg, reg->slot, reg->mask, n);
+    reg->count++;
+
+    if (row != NULL)
+        *row = n;
+
+    return 0;
+}
+
+int beacon_reg_find(const beacon_reg_s* reg, const beacon_key_s* key)
+{
+    uint32_t i;
+
+    if (reg->count == 0)
+        return -1;
+
+    for (i = beacon_key_hash(key) & reg->mask; reg->slot[i] != 0; i = (i + 1) & reg->mask) {
+        if (beacon_key_equal(&reg->key[reg->slot[i] - 1], key))
+            return (int)reg->slot[i] - 1;
+    }
+
+    return -1;
+}
+
+static uint32_t snap_sum(uint32_t hash, const void* data, size_t len)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+/* offset and length of the sections, retval the file size */
+static uint64_t snap_layout(uint32_t count, uint32_t slots, uint32_t pool_len, uint32_t tags_len, uint64_t* off, uint64_t* len)
+{
+    uint64_t pos = BEACON_SNAP_ALIGN(sizeof(beacon_snap_hdr_s));
+    size_t i;
+
+    for (i = 0; i < SNAP_SECTIONS; i++) {
+        if (i < SNAP_COLUMNS)
+            len[i] = (uint64_t)count * snap_columns[i].size;
+        else if (i == SNAP_COLUMNS)
+            len[i] = (uint64_t)slots * sizeof(uint32_t);
+        else if (i == SNAP_COLUMNS + 1)
+            len[i] = pool_len;
+        else
+            len[i] = tags_len;
+        off[i] = pos;
+        pos = BEACON_SNAP_ALIGN(pos + len[i]);
+    }
+
+    return pos;
+}
+
+int beacon_reg_save(const beacon_reg_s* reg, const char* path, const char* const* tags, int ntags, uint32_t* checksum)
+{
+    static const char zero[8] = {0};
+    beacon_snap_hdr_s hdr;
+    const void* data[SNAP_SECTIONS];
+    uint64_t off[SNAP_SECTIONS], len[SNAP_SECTIONS], pos;
+    char* tagbuf = NULL;
+    char* tmp = NULL;
+    FILE* fp = NULL;
+    size_t i, n, tags_len = 0;
+    int rc = -1;
+
+    for (i = 0; i < (size_t)ntags; i++)
+        tags_len += strlen(tags[i] ? tags[i] : "") + 1;
+    tagbuf = (char*)lgw_malloc(tags_len + 1);
+    if (tagbuf == NULL)
+        return -1;
+    for (i = 0, n = 0; i < (size_t)ntags; i++) {
+        strcpy(tagbuf + n, tags[i] ? tags[i] : "");
+        n += strlen(tagbuf + n) + 1;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, BEACON_SNAP_MAGIC, sizeof(hdr.magic));
+    hdr.version = BEACON_SNAP_VERSION;
+    hdr.order = BEACON_SNAP_ORDER;
+    hdr.key_size = sizeof(beacon_key_s);
+    hdr.count = (uint32_t)reg->count;
+    hdr.slots = reg->slot ? reg->mask + 1 : 0;
+    hdr.pool_len = reg->pool_len;
+    hdr.ntags = (uint32_t)ntags;
+    hdr.tags_len = (uint32_t)tags_len;
+    hdr.size = snap_layout(hdr.count, hdr.slots, hdr.pool_len, hdr.tags_len, off, len);
+
+    for (i = 0; i < SNAP_COLUMNS; i++)
+        data[i] = SNAP_COLUMN(reg, i);
+    data[SNAP_COLUMNS] = reg->slot;
+    data[SNAP_COLUMNS + 1] = reg->pool;
+    data[SNAP_COLUMNS + 2] = tagbuf;
+
+    hdr.checksum = 2166136261u;
+    for (i = 0; i < SNAP_SECTIONS; i++)
+        hdr.checksum = snap_sum(hdr.checksum, data[i], len[i]);
+    if (hdr.checksum == 0)
+        hdr.checksum = 1;   // 0 means no snapshot
+
+    if (checksum != NULL && *checksum == hdr.checksum) {
+        lgw_free(tagbuf);
+        return 1;
+    }
+
+    if (lgw_asprintf(&tmp, "%s.tmp", path) < 0)
+        goto out;
+
+    fp = fopen(tmp, "wb");
+    if (fp == NULL)
+        goto out;
+
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1)
+        goto out;
+    pos = sizeof(hdr);
+    for (i = 0; i < SNAP_SECTIONS; i++) {
+        if (fwrite(zero, 1, off[i] - pos, fp) != off[i] - pos)
+            goto out;
+        if (len[i] != 0 && fwrite(data[i], 1, len[i], fp) != len[i])
+            goto out;
+        pos = off[i] + len[i];
+    }
+    if (fwrite(zero, 1, hdr.size - pos, fp) != hdr.size - pos)
+        goto out;
+
+    if (fflush(fp) || fsync(fileno(fp)))
+        goto out;
+    rc = fclose(fp);
+    fp = NULL;
+    if (rc == 0)
+        rc = rename(tmp, path);
+
+out:
+    if (fp != NULL)
+        fclose(fp);
+    if (rc != 0 && tmp != NULL)
+        unlink(tmp);
+    if (rc == 0 && checksum != NULL)
+        *checksum = hdr.checksum;
+    lgw_free(tmp);
+    lgw_free(tagbuf);
+
+    return rc ? -1 : 0;
+}
+
+/* every offset of the columns and of the key index stays inside its target */
+static int snap_check(const beacon_reg_s* reg, uint32_t slots)
+{
+    uint32_t i;
+    int row;
+
+    for (row = 0; row < reg->count; row++) {
+        if (reg->id[row] >= reg->pool_len || reg->venueid[row] >= reg->pool_len || reg->orgid[row] >= reg->pool_len ||
+                reg->place_tail[row] >= reg->pool_len || reg->place_tail_len[row] > reg->pool_len - reg->place_tail[row])
+            return -1;
+    }
+    for (i = 0; i < slots; i++) {
+        if (reg->slot[i] > (uint32_t)reg->count)
+            return -1;
+    }
+    if (reg->pool_len != 0 && reg->pool[reg->pool_len - 1] != '\0')
+        return -1;
+
+    return 0;
+}
+
+int beacon_reg_load(beacon_reg_s* reg, const char* path, const char** tags, int ntags, uint32_t* checksum)
+{
+    const beacon_snap_hdr_s* hdr;
+    uint64_t off[SNAP_SECTIONS], len[SNAP_SECTIONS];
+    struct stat st;
+    uint32_t sum = 2166136261u;
+    const char* tag;
+    char* map;
+    size_t i;
+    int fd;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) || (size_t)st.st_size < sizeof(beacon_snap_hdr_s)) {
+        close(fd);
+        return -1;
+    }
+    map = (char*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+
+    hdr = (const beacon_snap_hdr_s*)map;
+    if (memcmp(hdr->magic, BEACON_SNAP_MAGIC, sizeof(hdr->magic)) || hdr->version != BEACON_SNAP_VERSION ||
+            hdr->order != BEACON_SNAP_ORDER || hdr->key_size != sizeof(beacon_key_s) ||
+            hdr->ntags != (uint32_t)ntags || hdr->size != (uint64_t)st.st_size ||
+            (hdr->slots & (hdr->slots - 1)) != 0 || (hdr->count != 0 && hdr->slots < hdr->count * 2) ||
+            snap_layout(hdr->count, hdr->slots, hdr->pool_len, hdr->tags_len, off, len) != hdr->size)
+        goto fail;
+
+    for (i = 0; i < SNAP_SECTIONS; i++)
+        sum = snap_sum(sum, map + off[i], len[i]);
+    if ((sum ? sum : 1) != hdr->checksum)
+        goto fail;
+
+    /* the tags, exactly ntags null terminated strings */
+    tag = map + off[SNAP_SECTIONS - 1];
+    for (i = 0; i < (size_t)ntags; i++) {
+        if (tag >= map + off[SNAP_SECTIONS - 1] + hdr->tags_len)
+            goto fail;
+        tags[i] = tag;
+        tag = memchr(tag, '\0', map + off[SNAP_SECTIONS - 1] + hdr->tags_len - tag);
+        if (tag == NULL)
+            goto fail;
+        tag++;
+    }
+
+    beacon_reg_init(reg);
+    for (i = 0; i < SNAP_COLUMNS; i++)
+        SNAP_COLUMN(reg, i) = map + off[i];
+    reg->count = reg->capacity = (int)hdr->count;
+    reg->slot = (uint32_t*)(map + off[SNAP_COLUMNS]);
+    reg->mask = hdr->slots ? hdr->slots - 1 : 0;
+    reg->pool = map + off[SNAP_COLUMNS + 1];
+    reg->pool_len = reg->pool_size = hdr->pool_len;
+    reg->map = map;
+    reg->map_len = st.st_size;
+
+    if (snap_check(reg, hdr->slots)) {
+        beacon_reg_init(reg);
+        goto fail;
+    }
+
+    if (checksum != NULL)
+        *checksum = hdr->checksum;
+
+    return 0;
+
+fail:
+    munmap(map, st.st_size);
+    return -1;
+}
+
+size_t beacon_reg_memory(const beacon_reg_s* reg)
+{
+    size_t row = sizeof(beacon_key_s) + sizeof(int32_t) + 2 * sizeof(double) + 5 * sizeof(uint32_t);
+
+    if (reg->map != NULL)
+        return reg->map_len;
+
+    return (size_t)reg->capacity * row + (reg->slot ? (reg->mask + 1) * sizeof(uint32_t) : 0) +
+        reg->pool_size + (reg->str_slot ? (reg->str_mask + 1) * sizeof(uint32_t) : 0);
+}
+
+void beacon_reg_free(beacon_reg_s* reg)
+{
+    if (reg->map != NULL) {
+        munmap(reg->map, reg->map_len);
+        beacon_reg_init(reg);
+        return;
+    }
+
+    lgw_free(reg->key);
+    lgw_free(reg->floor);
+    lgw_free(reg->lat);
+    lgw_free(reg->lon);
+    lgw_free(reg->id);
+    lgw_free(reg->venueid);
+    lgw_free(reg->orgid);
+    lgw_free(reg->place_tail);
+    lgw_free(reg->place_tail_len);
+    lgw_free(reg->slot);
+    lgw_free(reg->pool);
+    lgw_free(reg->str_slot);
+    beacon_reg_init(reg);
+}
@@ -0,0 +1,140 @@
+/*
+ *  ____  ____      _    ____ ___ _   _  ___
+ *  |  _ \|  _ \    / \  / ___|_ _| \ | |/ _ \
+ *  | | | | |_) |  / _ \| |  _ | ||  \| | | | |
+ *  | |_| |  _ <  / ___ \ |_| || || |\  | |_| |
+ *  |____/|_| \_\/_/   \_\____|___|_| \_|\___/
+ *
+ * location service -- An opensource of lorawan location service
+ *
+ * See http://www.dragino.com for more information about
+ * the lora gateway project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ *
+ * Maintainer: skerlan
+ *
+ */
+
+/*! \file
+ *
+ * \brief epoch based reclamation of shared snapshots
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "utilities.h"
+#include "epoch.h"
+
+/*
+ * Ordering: all the accesses below are sequentially consistent. A reader
+ * which stores its slot after the writer scanned it also loads the shared
+ * pointer after the writer published the new one, so it can't see the
+ * snapshot being released.
+ */
+
+void lgw_epoch_init(lgw_epoch_s* ep)
+{
+    memset(ep, 0, sizeof(lgw_epoch_s));
+    ep->epoch = 1;
+}
+
+int lgw_epoch_register(lgw_epoch_s* ep)
+{
+    int reader = __atomic_fetch_add(&ep->readers, 1, __ATOMIC_SEQ_CST);
+
+    if (reader >= EPOCH_MAX_READERS) {
+        __atomic_fetch_sub(&ep->readers, 1, __ATOMIC_SEQ_CST);
+        return -1;
+    }
+
+    return reader;
+}
+
+void lgw_epoch_enter(lgw_epoch_s* ep, int reader)
+{
+    __atomic_store_n(&ep->reader[reader], __atomic_load_n(&ep->epoch, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+}
+
+void lgw_epoch_exit(lgw_epoch_s* ep, int reader)
+{
+    __atomic_store_n(&ep->reader[reader], 0, __ATOMIC_SEQ_CST);
+}
+
+/* true when no reader is inside an epoch older than epoch */
+static int epoch_safe(lgw_epoch_s* ep, uint64_t epoch)
+{
+    uint64_t seen;
+    int i, readers = __atomic_load_n(&ep->readers, __ATOMIC_SEQ_CST);
+
+    for (i = 0; i < readers && i < EPOCH_MAX_READERS; i++) {
+        seen = __atomic_load_n(&ep->reader[i], __ATOMIC_SEQ_CST);
+        if (seen != 0 && seen < epoch)
+            return 0;
+    }
+
+    return 1;
+}
+
+void lgw_epoch_retire(lgw_epoch_s* ep, void* ptr, void (*release)(void* ptr))
+{
+    epoch_retired_s* retired;
+    uint64_t epoch;
+
+    if (ptr == NULL)
+        return;
+
+    epoch = __atomic_add_fetch(&ep->epoch, 1, __ATOMIC_SEQ_CST);
+
+    retired = (epoch_retired_s*)lgw_malloc(sizeof(epoch_retired_s));
+    if (retired == NULL) {
+        /* can't defer, wait for the readers instead, a critical section is short */
+        while (!epoch_safe(ep, epoch))
+            usleep(1000);
+        release(ptr);
+        return;
+    }
+
+    retired->ptr = ptr;
+    retired->release = release;
+    retired->epoch = epoch;
+    retired->next = ep->retired;
+    ep->retired = retired;
+}
+
+int lgw_epoch_reclaim(lgw_epoch_s* ep)
+{
+    epoch_retired_s** link = &ep->retired;
+    epoch_retired_s* retired;
+    int pending = 0;
+
+    while ((retired = *link) != NULL) {
+        if (!epoch_safe(ep, retired->epoch)) {
+            link = &retired->next;
+            pending++;
+            continue;
+        }
+        *link = retired->next;
+        retired->release(retired->ptr);
+        lgw_free(retired);
+    }
+
+    return pending;
+}
+
+void lgw_epoch_destroy(lgw_epoch_s* ep)
+{
+    epoch_retired_s* retired;
+
+    while ((retired = ep->retired) != NULL) {
+        ep->retired = retired->next;
+        retired->release(retired->ptr);
+        lgw_free(retired);
+    }
+}
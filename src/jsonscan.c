@@ -0,0 +1,397 @@
+/*
+ *  ____  ____      _    ____ ___ _   _  ___
+ *  |  _ \|  _ \    / \  / ___|_ _| \ | |/ _ \
+ *  | | | | |_) |  / _ \| |  _ | ||  \| | | | |
+ *  | |_| |  _ <  / ___ \ |_| || || |\  | |_| |
+ *  |____/|_| \_\/_/   \_\____|___|_| \_|\___/
+ *
+ * location service -- An opensource of lorawan location service
+ *
+ * See http://www.dragino.com for more information about
+ * the lora gateway project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ *
+ * Maintainer: skerlan
+ *
+ */
+
+/*! \file
+ *
+ * \brief single pass JSON field extractor
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "jsonscan.h"
+
+#define SCAN_NUM_BUF    64
+
+typedef struct {
+    const char* p;
+    const char* end;
+} cursor_s;
+
+static void skip_ws(cursor_s* c)
+{
+    while (c->p < c->end && (*c->p == ' ' || *c->p == '\t' || *c->p == '\n' || *c->p == '\r'))
+        c->p++;
+}
+
+/* c->p is on the opening quote, leaves c->p after the closing quote */
+static int skip_string(cursor_s* c)
+{
+    c->p++;
+    while (c->p < c->end) {
+        if (*c->p == '\\') {
+            c->p += 2;
+            continue;
+        }
+        if (*c->p++ == '"')
+            return 0;
+    }
+    return -1;
+}
+
+/* skip any value, containers are skipped by bracket counting only */
+static int skip_value(cursor_s* c)
+{
+    int nesting = 0;
+
+    if (c->p >= c->end)
+        return -1;
+
+    switch (*c->p) {
+        case '"':
+            return skip_string(c);
+        case '{':
+        case '[':
+            while (c->p < c->end) {
+                switch (*c->p) {
+                    case '"':
+                        if (skip_string(c))
+                            return -1;
+                        continue;
+                    case '{':
+                    case '[':
+                        nesting++;
+                        break;
+                    case '}':
+                    case ']':
+                        if (--nesting == 0) {
+                            c->p++;
+                            return 0;
+                        }
+                        break;
+                    default:
+                        break;
+                }
+                c->p++;
+            }
+            return -1;
+        case '}':
+        case ']':
+        case ',':
+        case ':':
+            return -1;
+        default:    // number, true, false, null
+            while (c->p < c->end && *c->p != ',' && *c->p != '}' && *c->p != ']' &&
+                    *c->p != ' ' && *c->p != '\t' && *c->p != '\n' && *c->p != '\r')
+                c->p++;
+            return 0;
+    }
+}
+
+static void record_value(json_scan_value_s* value, const char* start, const char* end)
+{
+    switch (*start) {
+        case '"':
+            value->type = JSON_SCAN_STRING;
+            value->ptr = start + 1;
+            value->len = end - start - 2;
+            value->escaped = memchr(value->ptr, '\\', value->len) != NULL;
+            return;
+        case '{':
+            value->type = JSON_SCAN_OBJECT;
+            break;
+        case '[':
+            value->type = JSON_SCAN_ARRAY;
+            break;
+        case 't':
+        case 'f':
+            value->type = JSON_SCAN_BOOLEAN;
+            break;
+        case 'n':
+            value->type = JSON_SCAN_NULL;
+            break;
+        default:
+            value->type = JSON_SCAN_NUMBER;
+            break;
+    }
+    value->ptr = start;
+    value->len = end - start;
+    value->escaped = 0;
+}
+
+/*!
+ * \brief scan the object at c->p for the candidate paths
+ * \param cand bit mask of the paths whose first depth levels lead here
+ * \param todo bit mask of the paths not found yet
+ * \retval 0 object done, 1 every path found (stop), -1 syntax error
+ */
+
+static int scan_object(const json_scan_s* scan, cursor_s* c, int depth, uint32_t cand,
+        json_scan_value_s* values, uint32_t* todo)
+{
+    const json_scan_path_s* path;
+    const char* key;
+    const char* start;
+    size_t klen;
+    uint32_t leaf, deeper;
+    int i, rc;
+
+    c->p++;     // '{'
+    skip_ws(c);
+    if (c->p < c->end && *c->p == '}') {
+        c->p++;
+        return 0;
+    }
+
+    while (c->p < c->end) {
+        if (*c->p != '"')
+            return -1;
+        key = c->p + 1;
+        if (skip_string(c))
+            return -1;
+        klen = c->p - key - 1;
+
+        skip_ws(c);
+        if (c->p >= c->end || *c->p != ':')
+            return -1;
+        c->p++;
+        skip_ws(c);
+
+        leaf = deeper = 0;
+        for (i = 0; i < scan->count; i++) {
+            if (!(cand & (1u << i)))
+                continue;
+            path = &scan->path[i];
+            if (path->len[depth] != klen || memcmp(path->level[depth], key, klen))
+                continue;
+            if (path->depth == depth + 1)
+                leaf |= (1u << i);
+            else
+                deeper |= (1u << i);
+        }
+
+        start = c->p;
+        if (deeper && c->p < c->end && *c->p == '{') {
+            rc = scan_object(scan, c, depth + 1, deeper, values, todo);
+            if (rc)
+                return rc;
+        } else if (skip_value(c))
+            return -1;
+
+        if (leaf & *todo) {
+            for (i = 0; i < scan->count; i++) {
+                if (leaf & *todo & (1u << i))
+                    record_value(&values[i], start, c->p);
+            }
+            *todo &= ~leaf;
+            if (*todo == 0)
+                return 1;   // nothing left to look for, don't read the rest
+        }
+
+        skip_ws(c);
+        if (c->p >= c->end)
+            return -1;
+        if (*c->p == '}') {
+            c->p++;
+            return 0;
+        }
+        if (*c->p != ',')
+            return -1;
+        c->p++;
+        skip_ws(c);
+    }
+
+    return -1;
+}
+
+int json_scan_compile(json_scan_s* scan, const char** paths, int count)
+{
+    json_scan_path_s* path;
+    const char* level;
+    const char* dot;
+    int i;
+
+    if (count > JSON_SCAN_MAX_PATHS)
+        return -1;
+
+    memset(scan, 0, sizeof(json_scan_s));
+
+    for (i = 0; i < count; i++) {
+        path = &scan->path[i];
+        level = paths[i];
+        for (;;) {
+            if (path->depth == JSON_SCAN_MAX_DEPTH)
+                return -1;
+            dot = strchr(level, '.');
+            path->level[path->depth] = level;
+            path->len[path->depth] = dot ? (size_t)(dot - level) : strlen(level);
+            path->depth++;
+            if (dot == NULL)
+                break;
+            level = dot + 1;
+        }
+    }
+
+    scan->count = count;
+
+    return 0;
+}
+
+int json_scan(const json_scan_s* scan, const char* json, size_t len, json_scan_value_s* values)
+{
+    cursor_s c = { json, json + len };
+    uint32_t all, todo;
+    int i, found = 0;
+
+    all = (scan->count == 32) ? 0xFFFFFFFFu : ((1u << scan->count) - 1);
+    todo = all;
+
+    for (i = 0; i < scan->count; i++)
+        values[i].type = JSON_SCAN_NONE;
+
+    skip_ws(&c);
+    if (c.p >= c.end || *c.p != '{')
+        return -1;
+
+    if (scan_object(scan, &c, 0, all, values, &todo) < 0)
+        return -1;
+
+    for (i = 0; i < scan->count; i++) {
+        if (values[i].type != JSON_SCAN_NONE)
+            found++;
+    }
+
+    return found;
+}
+
+static int hex_value(char ch)
+{
+    if (ch >= '0' && ch <= '9')
+        return ch - '0';
+    if (ch >= 'a' && ch <= 'f')
+        return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F')
+        return ch - 'A' + 10;
+    return -1;
+}
+
+static int parse_hex4(const char* s, const char* end, unsigned int* cp)
+{
+    int i, h;
+
+    if (end - s < 4)
+        return -1;
+    *cp = 0;
+    for (i = 0; i < 4; i++) {
+        if ((h = hex_value(s[i])) < 0)
+            return -1;
+        *cp = (*cp << 4) | h;
+    }
+    return 0;
+}
+
+int json_scan_get_string(const json_scan_value_s* value, char* buf, size_t size)
+{
+    const char* s;
+    const char* end;
+    unsigned int cp, lo;
+    size_t n = 0;
+
+    if (value->type != JSON_SCAN_STRING || size == 0)
+        return -1;
+
+    if (!value->escaped) {
+        if (value->len >= size)
+            return -1;
+        memcpy(buf, value->ptr, value->len);
+        buf[value->len] = '\0';
+        return (int)value->len;
+    }
+
+    s = value->ptr;
+    end = s + value->len;
+    while (s < end) {
+        if (n + 4 >= size)
+            return -1;
+        if (*s != '\\') {
+            buf[n++] = *s++;
+            continue;
+        }
+        if (++s >= end)
+            return -1;
+        switch (*s++) {
+            case '"':  buf[n++] = '"';  break;
+            case '\\': buf[n++] = '\\'; break;
+            case '/':  buf[n++] = '/';  break;
+            case 'b':  buf[n++] = '\b'; break;
+            case 'f':  buf[n++] = '\f'; break;
+            case 'n':  buf[n++] = '\n'; break;
+            case 'r':  buf[n++] = '\r'; break;
+            case 't':  buf[n++] = '\t'; break;
+            case 'u':
+                if (parse_hex4(s, end, &cp))
+                    return -1;
+                s += 4;
+                if (cp >= 0xD800 && cp <= 0xDBFF) {     // surrogate pair
+                    if (end - s < 6 || s[0] != '\\' || s[1] != 'u' || parse_hex4(s + 2, end, &lo) ||
+                            lo < 0xDC00 || lo > 0xDFFF)
+                        return -1;
+                    s += 6;
+                    cp = 0x10000 + (((cp & 0x3FF) << 10) | (lo & 0x3FF));
+                }
+                if (cp < 0x80) {
+                    buf[n++] = (char)cp;
+                } else if (cp < 0x800) {
+                    buf[n++] = (char)(0xC0 | (cp >> 6));
+                    buf[n++] = (char)(0x80 | (cp & 0x3F));
+                } else if (cp < 0x10000) {
+                    buf[n++] = (char)(0xE0 | (cp >> 12));
+                    buf[n++] = (char)(0x80 | ((cp >> 6) & 0x3F));
+                    buf[n++] = (char)(0x80 | (cp & 0x3F));
+                } else {
+                    buf[n++] = (char)(0xF0 | (cp >> 18));
+                    buf[n++] = (char)(0x80 | ((cp >> 12) & 0x3F));
+                    buf[n++] = (char)(0x80 | ((cp >> 6) & 0x3F));
+                    buf[n++] = (char)(0x80 | (cp & 0x3F));
+                }
+                break;
+            default:
+                return -1;
+        }
+    }
+    buf[n] = '\0';
+
+    return (int)n;
+}
+
+double json_scan_get_number(const json_scan_value_s* value)
+{
+    char num[SCAN_NUM_BUF];
+
+    if ((value->type != JSON_SCAN_NUMBER && value->type != JSON_SCAN_STRING) || value->len >= sizeof(num))
+        return 0;
+
+    memcpy(num, value->ptr, value->len);
+    num[value->len] = '\0';
+
+    return strtod(num, NULL);
+}
@@ -0,0 +1,189 @@
+/*
+ *  ____  ____      _    ____ ___ _   _  ___
+ *  |  _ \|  _ \    / \  / ___|_ _| \ | |/ _ \
+ *  | | | | |_) |  / _ \| |  _ | ||  \| | | | |
+ *  | |_| |  _ <  / ___ \ |_| || || |\  | |_| |
+ *  |____/|_| \_\/_/   \_\____|___|_| \_|\___/
+ *
+ * location service -- An opensource of lorawan location service
+ *
+ * See http://www.dragino.com for more information about
+ * the lora gateway project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ *
+ * Maintainer: skerlan
+ *
+ */
+
+/*! \file
+ *
+ * \brief incremental splitter of a JSON array
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "utilities.h"
+#include "jsonstream.h"
+
+#define JSON_STREAM_MIN_BUF     512
+
+enum {
+    STREAM_START,               /* before the '[' */
+    STREAM_VALUE,               /* before an element or the ']' of an empty array */
+    STREAM_ELEMENT,             /* inside an element */
+    STREAM_NEXT,                /* after an element, before ',' or ']' */
+    STREAM_DONE,                /* after the ']' */
+    STREAM_ERROR
+};
+
+#define IS_WS(ch)   ((ch) == ' ' || (ch) == '\t' || (ch) == '\n' || (ch) == '\r')
+
+static int stream_append(json_stream_s* stream, const char* data, size_t len)
+{
+    size_t size;
+    char* buf;
+
+    if (stream->len + len + 1 > stream->size) {
+        if (stream->len + len >= JSON_STREAM_MAX_ELEMENT)
+            return -1;
+        size = stream->size ? stream->size : JSON_STREAM_MIN_BUF;
+        while (size < stream->len + len + 1)
+            size *= 2;
+        buf = (char*)lgw_realloc(stream->buf, size);
+        if (buf == NULL)
+            return -1;
+        stream->buf = buf;
+        stream->size = size;
+    }
+
+    memcpy(stream->buf + stream->len, data, len);
+    stream->len += len;
+
+    return 0;
+}
+
+/* the element in buf is complete */
+static int stream_emit(json_stream_s* stream)
+{
+    int rc;
+
+    stream->buf[stream->len] = '\0';
+    rc = stream->cb(stream->ctx, stream->buf, stream->len);
+    stream->len = 0;
+    stream->count++;
+
+    return rc ? -1 : 0;
+}
+
+void json_stream_init(json_stream_s* stream, json_stream_cb cb, void* ctx)
+{
+    memset(stream, 0, sizeof(json_stream_s));
+    stream->state = STREAM_START;
+    stream->cb = cb;
+    stream->ctx = ctx;
+}
+
+int json_stream_feed(json_stream_s* stream, const char* data, size_t len)
+{
+    const char* p = data;
+    const char* end = data + len;
+    const char* start;
+    int done;
+    char ch;
+
+    while (p < end) {
+        switch (stream->state) {
+        case STREAM_START:
+        case STREAM_VALUE:
+        case STREAM_NEXT:
+        case STREAM_DONE:
+            ch = *p++;
+            if (IS_WS(ch))
+                continue;
+            if (stream->state == STREAM_START && ch == '[')
+                stream->state = STREAM_VALUE;
+            else if ((stream->state == STREAM_VALUE && stream->count == 0 && ch == ']') ||
+                    (stream->state == STREAM_NEXT && ch == ']'))
+                stream->state = STREAM_DONE;
+            else if (stream->state == STREAM_NEXT && ch == ',')
+                stream->state = STREAM_VALUE;
+            else if (stream->state == STREAM_VALUE && ch != ',' && ch != ']' && ch != '}' && ch != ':') {
+                stream->state = STREAM_ELEMENT;
+                stream->depth = 0;
+                stream->in_string = stream->escape = 0;
+                p--;
+            } else
+                goto fail;
+            break;
+
+        case STREAM_ELEMENT:
+            /* copy up to the end of the element, or of the chunk, at once */
+            start = p;
+            done = 0;
+            while (p < end && !done) {
+                ch = *p;
+                if (stream->in_string) {
+                    if (stream->escape)
+                        stream->escape = 0;
+                    else if (ch == '\\')
+                        stream->escape = 1;
+                    else if (ch == '"') {
+                        stream->in_string = 0;
+                        done = stream->depth == 0;  // a string element
+                    }
+                } else if (ch == '"')
+                    stream->in_string = 1;
+                else if (ch == '{' || ch == '[')
+                    stream->depth++;
+                else if (ch == '}' || ch == ']') {
+                    if (stream->depth == 0) {       // end of a scalar element, and of the array
+                        done = 1;
+                        break;
+                    }
+                    done = --stream->depth == 0;
+                } else if (stream->depth == 0 && (ch == ',' || IS_WS(ch))) {
+                    done = 1;                       // end of a scalar element
+                    break;
+                }
+                p++;
+            }
+            if (stream_append(stream, start, p - start))
+                goto fail;
+            if (done) {
+                stream->state = STREAM_NEXT;
+                if (stream_emit(stream))
+                    goto fail;
+            }
+            break;
+
+        default:
+            return -1;
+        }
+    }
+
+    return 0;
+
+fail:
+    stream->state = STREAM_ERROR;
+    return -1;
+}
+
+int json_stream_end(json_stream_s* stream)
+{
+    if (stream->state != STREAM_DONE)
+        return -1;
+
+    return (int)stream->count;
+}
+
+void json_stream_free(json_stream_s* stream)
+{
+    lgw_free(stream->buf);
+    stream->size = stream->len = 0;
+}
@@ -25,27 +25,52 @@
  *
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdbool.h>
 #include <signal.h> 
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
 #include <math.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <errno.h> 
 #include <string.h>
+#include <strings.h>
+#include <fnmatch.h>
 #include <curl/curl.h>
 
 #include "MQTTAsync.h"
 #include "parson.h"
 #include "linkedlists.h"
 #include "utilities.h"
+#include "ringbuf.h"
+#include "topictrie.h"
+#include "jsonscan.h"
+#include "jsonstream.h"
+#include "base64.h"
+#include "beacondec.h"
+#include "beaconreg.h"
+#include "epoch.h"
 #include "location.h"
 #include "mapwize_api.h"
 
 #define DEFAULT_MQTT_CLIENTID     "DRAGINO_MQTT_CLIENT"
 #define DEFAULT_URL_LEN           100
 #define DEFAULT_LOOP_MS           10000UL   
+#define DEFAULT_STATS_MS          60000     /* period of the pipeline statistics */
+#define DEFAULT_PAYLOAD_RING      1024      /* slots between msgarrvd and parser */
+#define DEFAULT_PAYLOAD_BATCH     32        /* payloads drained per pass */
+#define DEFAULT_SNAPSHOT          "/etc/location_beacons.snap"
+#define MAX_PARSE_WORKERS         64
+#define MAX_BEACON_REFRESH        86400     /* seconds, once a day */
+#define MAX_MQTT_CONNECTIONS      16
+#define DEVICE_HASH_SIZE          1024      /* buckets of the device table, power of two */
+#define PLACE_COORD_PREC          15        /* decimals of the place coordinates */
+#define PLACE_STATE_EPS           1e-7      /* degrees, a place closer than that didn't move */
+#define MAX_RECONCILE_MS          60000
+#define PLACE_ID_PREFIX           "7f9abcd9"
 #define DEFUALT_KEEPALIVE         5000L
 #define TIMEOUT                   10000L
 
@@ -67,33 +92,126 @@ volatile bool quit_sig = false; /* 1 -> application terminates without shutting
 /* location configure */
 loccfg_s loccfg = LOCCFG_INIT;
 
-int disc_finished = 0;
-int subscribed = 0;
-int finished = 0;
-
-/* define a list head for payload */
-LGW_LIST_HEAD_STATIC(payload_list, _payload_s);
-
-/* define a list head for payload */
-LGW_LIST_HEAD_STATIC(inode_list, _inode_s);
-
-/* define a list head for ibeacon */
-LGW_LIST_HEAD_NOLOCK_STATIC(ibeacon_list, _ibeacon_s);
-
-/* define payload parse sem */
-sem_t parse_payload_sem;
-
-/* define payload parse sem */
-sem_t parse_inode_sem;
+/* define the mqtt connections, all of them feed parse_workers */
+mqtt_conn_s* mqtt_conns = NULL;
+
+/* define the compiled topic filters, topic name -> topic_s */
+lgw_trie_s topic_trie;
+
+/* define the parser pool, msgarrvd -> ring of worker -> thread_parse_payload */
+parse_worker_s* parse_workers = NULL;
+
+/* define a table of the latest location per device, the lock of dirty_list protects it */
+dnode_s* device_table[DEVICE_HASH_SIZE];
+
+/* define a list head for the devices which have a pending location */
+LGW_LIST_HEAD_STATIC(dirty_list, _dnode_s);
+
+/* number of readings replaced by a newer one before being published */
+uint64_t coalesced = 0;
+
+/* number of places created, updated and deleted in mapwize, and of readings which didn't move their place */
+uint64_t created = 0;
+uint64_t updated = 0;
+uint64_t deleted = 0;
+uint64_t unchanged = 0;
+
+/* define the published registry of the mapwize ibeacons, only read inside beacon_epoch */
+beacon_reg_s* beacon_snap = NULL;
+
+/* define the epoch domain of beacon_snap, a replaced registry is freed when no reader holds it */
+lgw_epoch_s beacon_epoch;
+
+/* define the doorbell of thread_refresh_beacons, rung to stop it */
+int refresh_efd = -1;
+
+/* the published registry came from the snapshot and is not yet checked against mapwize */
+int beacons_stale = 0;
+
+/* checksum of the snapshot file, an unchanged beacon list is not written again */
+uint32_t snapshot_sum = 0;
+
+/* define the configure a snapshot was built with, the tags saved with it */
+enum {
+    SNAP_ORGID,
+    SNAP_UNIVERSES,
+    SNAP_PLACETYPE,
+    SNAP_PLACETYPEID,
+    SNAP_TAG_COUNT
+};
+
+/* define the doorbell of thread_create_place, rung when a device turns dirty */
+int inode_efd = -1;
+
+/* define the event loop of the main thread */
+lgw_evloop_s main_loop;
+
+/* define the arena of the mapwize responses, reset after each response */
+JSON_Arena* mapwize_arena = NULL;
+
+/* define the client of every mapwize request, its connections are kept alive */
+mapwize_client_s mapwize_client;
+
+/* define a table of the places of the devices, desired and acknowledged state, owned by thread_create_place */
+pnode_s* place_table[DEVICE_HASH_SIZE];
+
+/* define the queue of the places the reconciler has to look at */
+pnode_s* place_queue = NULL;
+pnode_s* place_queue_tail = NULL;
+
+/* ms from which a queued place can be sent, the places failed lately wait for their retry */
+uint64_t place_due = 0;
+
+/* the places were listed at startup, a place not in the table doesn't exist in mapwize */
+int places_listed = 0;
+
+/* define the fields of a listed place, index of place_paths */
+enum {
+    PLACE_ID,
+    PLACE_FLOOR,
+    PLACE_COORDINATES,
+    PLACE_FIELD_COUNT
+};
+
+static const char* place_paths[PLACE_FIELD_COUNT] = {
+    "_id",
+    "floor",
+    "geometry.coordinates"
+};
+
+/* define the fields of a TTN uplink, index of ttn_paths */
+enum {
+    TTN_DEV_ID,
+    TTN_HARDWARE_SERIAL,
+    TTN_PAYLOAD_RAW,
+    TTN_PAYLOAD_FIELDS,
+    TTN_UUID,
+    TTN_MAJOR,
+    TTN_MINOR,
+    TTN_RSSI,
+    TTN_FIELD_COUNT
+};
+
+static const char* ttn_paths[TTN_FIELD_COUNT] = {
+    "dev_id",
+    "hardware_serial",
+    "payload_raw",
+    "payload_fields",
+    "payload_fields.UUID",
+    "payload_fields.MAJOR",
+    "payload_fields.MINOR",
+    "payload_fields.RSSI"
+};
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
 static int parse_serv_cfg(const char * conf_file);
 static void cfg_clean(loccfg_s* cfg);
 
-static int get_beacons(curlstr_s* cstr);
+static int get_beacon(void* ctx, char* elem, size_t len);
 static int get_placetype(curlstr_s* cstr);
 // mqtt connect function
+static int mqtt_connect(mqtt_conn_s* conn);
 static void connlost(void *context, char *cause);
 static int msgarrvd(void *context, char *topicName, int topicLen, MQTTAsync_message *message);
 static void onDisconnectFailure(void* context, MQTTAsync_failureData* response);
@@ -103,13 +221,43 @@ static void onSubscribeFailure(void* context, MQTTAsync_failureData* response);
 static void onConnectFailure(void* context, MQTTAsync_failureData* response);
 static void onConnect(void* context, MQTTAsync_successData* response);
 
-static void thread_parse_payload(void);
+static void* thread_parse_payload(void* arg);
 static void thread_create_place();
-
-
+static void thread_refresh_beacons();
+
+
+static uint32_t payload_shard_hash(const char* topic, const char* payload, int len);
+static void update_device(inode_s* inode);
+static int take_dirty_devices(inode_s** batch);
+static void free_device_table(void);
+static const beacon_layout_s* get_device_layout(const char* devid);
+static int decode_raw_beacons(inode_s* inode, const beacon_layout_s* layout, const json_scan_value_s* raw);
+static int load_placetype(void);
+static int load_beacons(void);
+static int load_snapshot(void);
+static void free_beacon_reg(void* reg);
+static int find_beacon(const beacon_reg_s* reg, const char* uuid, int major, int minor);
+static int build_place_tail(char** tail, const beacon_info_s* info);
+static int write_place(char* buf, size_t size, const inode_s* inode, const char* place_id, const char* tail, size_t tail_len);
+static uint64_t place_now(void);
+static bool same_place_state(const place_state_s* a, const place_state_s* b);
+static bool place_differs(const pnode_s* place);
+static pnode_s* get_place(const char* place_id);
+static void free_place_table(void);
+static void queue_place(pnode_s* place);
+static int want_place(const char* place_id, const place_state_s* state, const char* data, int len);
+static void expire_places(uint64_t now);
+static void reconcile_places(uint64_t now);
+static bool place_conflict(long status, const char* body, size_t len);
+static void on_place_done(void* ctx, int res, long status, const char* body, size_t len);
+static int get_listed_place(void* ctx, char* elem, size_t len);
+static int list_places(void);
 static float calc_dist_byrssi(int rssi, int rate, float div);
+static void free_payload_entry(payload_s* payload);
 static void free_inode_entry(inode_s* node);
+static char* scan_strdup(const json_scan_value_s* value);
 static void free_cfg_entry(loccfg_s* cfg);
+static serv_type_e get_serv_type(const char* str);
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
@@ -122,6 +270,37 @@ static void sig_handler(int sigio) {
     return;
 }
 
+static void on_signal(int fd, uint32_t events, void* data) {
+    struct signalfd_siginfo si;
+
+    (void)events;
+    (void)data;
+
+    while (read(fd, &si, sizeof(si)) == sizeof(si))
+        sig_handler(si.ssi_signo);
+}
+
+static void on_stats_timer(int fd, uint32_t events, void* data) {
+    int i;
+
+    (void)events;
+    (void)data;
+
+    lgw_eventfd_take(fd);
+
+    for (i = 0; i < loccfg.parse_workers; i++)
+        MSG_DEBUG(LOG_INFO, "INFO~ parse worker %d: depth=%zu, drops=%llu\n", i,
+                lgw_ring_depth(&parse_workers[i].ring),
+                (unsigned long long)lgw_ring_drops(&parse_workers[i].ring));
+
+    MSG_DEBUG(LOG_INFO, "INFO~ create place: coalesced=%llu, unchanged=%llu, created=%llu, updated=%llu, deleted=%llu\n",
+            (unsigned long long)__atomic_load_n(&coalesced, __ATOMIC_RELAXED),
+            (unsigned long long)__atomic_load_n(&unchanged, __ATOMIC_RELAXED),
+            (unsigned long long)__atomic_load_n(&created, __ATOMIC_RELAXED),
+            (unsigned long long)__atomic_load_n(&updated, __ATOMIC_RELAXED),
+            (unsigned long long)__atomic_load_n(&deleted, __ATOMIC_RELAXED));
+}
+
 static int parse_serv_cfg(const char * conf_file) {
     JSON_Value *root_val;
     JSON_Object *conf_obj = NULL;
@@ -129,6 +308,11 @@ static int parse_serv_cfg(const char * conf_file) {
     JSON_Array *serv_arry = NULL;
     JSON_Value *val = NULL; /* needed to detect the absence of some fields */
     const char *str; /* pointer to sub-strings in the JSON data */
+
+    topic_s* topic_entry = NULL;
+    model_s* model_entry = NULL;
+    char tmpstr[32];
+    int i, count;
 	
     /* try to parse JSON */
     root_val = json_parse_file_with_comments(conf_file);
@@ -193,6 +377,71 @@ static int parse_serv_cfg(const char * conf_file) {
         MSG_DEBUG(LOG_INFO, "INFO~ mqtt password is configured to %s\n", loccfg.topic);
     }
 
+    val = json_object_get_value(conf_obj, "connections");
+    if (val != NULL) {
+        loccfg.connections = (int)json_value_get_number(val);
+        if (loccfg.connections < 1)
+            loccfg.connections = 1;
+        else if (loccfg.connections > MAX_MQTT_CONNECTIONS)
+            loccfg.connections = MAX_MQTT_CONNECTIONS;
+        MSG_DEBUG(LOG_INFO, "INFO~ mqtt connections is configured to %d\n", loccfg.connections);
+    }
+
+    str = json_object_get_string(conf_obj, "shared_group");
+    if (str != NULL) {
+        loccfg.shared_group = lgw_strdup(str);
+        MSG_DEBUG(LOG_INFO, "INFO~ mqtt shared subscription group is configured to %s\n", loccfg.shared_group);
+    }
+
+    /* start config topic info, may be have some topic, identify by topic_id */
+    serv_arry = json_object_get_array(conf_obj, "topics");
+    if (serv_arry != NULL) {
+        count = json_array_get_count(serv_arry);
+        MSG_DEBUG(LOG_INFO, "INFO~ found %d topics\n", count);
+        for (i = 0; i < count; i++) {
+            serv_obj = json_array_get_object(serv_arry, i);
+            str = json_object_get_string(serv_obj, "topic");
+            if (str == NULL) {
+                MSG_DEBUG(LOG_WARNING, "WARNING~ topic %d has no topic filter, skip\n", i + 1);
+                continue;
+            }
+
+            topic_entry = lgw_malloc(sizeof(topic_s));
+            topic_entry->topic = lgw_strdup(str);
+            topic_entry->type = loccfg.serv_type;
+            topic_entry->qos = loccfg.qos;
+
+            str = json_object_get_string(serv_obj, "topic_id");
+            if (str != NULL) {
+                topic_entry->topic_id = lgw_strdup(str);
+            } else {
+                snprintf(tmpstr, sizeof(tmpstr), "topic_%d", i + 1);
+                topic_entry->topic_id = lgw_strdup(tmpstr);
+            }
+
+            str = json_object_get_string(serv_obj, "type");
+            if (str != NULL)
+                topic_entry->type = get_serv_type(str);
+
+            val = json_object_get_value(serv_obj, "qos");
+            if (val != NULL)
+                topic_entry->qos = (int)json_value_get_number(val);
+
+            MSG_DEBUG(LOG_INFO, "INFO~ topic %s is configured to \"%s\" (type %d, qos %d)\n",
+                    topic_entry->topic_id, topic_entry->topic, topic_entry->type, topic_entry->qos);
+            LGW_LIST_INSERT_TAIL(&loccfg.topic_list, topic_entry, list);
+        }
+    } else if (loccfg.topic != NULL) {
+        /* single topic configure, decoded as serv_type */
+        topic_entry = lgw_malloc(sizeof(topic_s));
+        topic_entry->topic_id = lgw_strdup("topic_1");
+        topic_entry->topic = lgw_strdup(loccfg.topic);
+        topic_entry->type = loccfg.serv_type;
+        topic_entry->qos = loccfg.qos;
+        LGW_LIST_INSERT_TAIL(&loccfg.topic_list, topic_entry, list);
+    } else 
+        MSG_DEBUG(LOG_WARNING, "WARNING~ No topic offer.\n");
+
     conf_obj = json_object_get_object(json_value_get_object(root_val), "mapwize_conf");
     if (conf_obj == NULL) {
         MSG_DEBUG(LOG_INFO, "INFO~ %s does not contain a JSON object named mapwize_conf\n", conf_file);
@@ -225,6 +474,51 @@ static int parse_serv_cfg(const char * conf_file) {
         MSG_DEBUG(LOG_INFO, "INFO~ placetype is configured to %s\n", loccfg.placetype);
     }
 
+    val = json_object_get_value(conf_obj, "beacon_refresh");
+    if (val != NULL) {
+        loccfg.beacon_refresh = (int)json_value_get_number(val);
+        if (loccfg.beacon_refresh < 0)
+            loccfg.beacon_refresh = 0;
+        else if (loccfg.beacon_refresh > MAX_BEACON_REFRESH)
+            loccfg.beacon_refresh = MAX_BEACON_REFRESH;
+        MSG_DEBUG(LOG_INFO, "INFO~ beacon_refresh is configured to %d seconds\n", loccfg.beacon_refresh);
+    }
+
+    str = json_object_get_string(conf_obj, "snapshot");
+    if (str != NULL) {
+        loccfg.snapshot = lgw_strdup(str);
+        MSG_DEBUG(LOG_INFO, "INFO~ snapshot is configured to \"%s\"\n", loccfg.snapshot);
+    } else
+        loccfg.snapshot = lgw_strdup(DEFAULT_SNAPSHOT);
+
+    val = json_object_get_value(conf_obj, "window");
+    if (val != NULL) {
+        loccfg.window = (int)json_value_get_number(val);
+        if (loccfg.window < 1)
+            loccfg.window = 1;
+        else if (loccfg.window > MAPWIZE_MAX_WINDOW)
+            loccfg.window = MAPWIZE_MAX_WINDOW;
+        MSG_DEBUG(LOG_INFO, "INFO~ window is configured to %d place updates in flight\n", loccfg.window);
+    }
+
+    val = json_object_get_value(conf_obj, "reconcile_ms");
+    if (val != NULL) {
+        loccfg.reconcile_ms = (int)json_value_get_number(val);
+        if (loccfg.reconcile_ms < 0)
+            loccfg.reconcile_ms = 0;
+        else if (loccfg.reconcile_ms > MAX_RECONCILE_MS)
+            loccfg.reconcile_ms = MAX_RECONCILE_MS;
+        MSG_DEBUG(LOG_INFO, "INFO~ reconcile_ms is configured to %d\n", loccfg.reconcile_ms);
+    }
+
+    val = json_object_get_value(conf_obj, "place_ttl");
+    if (val != NULL) {
+        loccfg.place_ttl = (int)json_value_get_number(val);
+        if (loccfg.place_ttl < 0)
+            loccfg.place_ttl = 0;
+        MSG_DEBUG(LOG_INFO, "INFO~ place_ttl is configured to %d seconds\n", loccfg.place_ttl);
+    }
+
     conf_obj = json_object_get_object(json_value_get_object(root_val), "rssi_conf");
     if (conf_obj == NULL) {
         MSG_DEBUG(LOG_INFO, "INFO~ %s does not contain a JSON object named rssi_conf\n", conf_file);
@@ -245,6 +539,53 @@ static int parse_serv_cfg(const char * conf_file) {
         MSG_DEBUG(LOG_INFO, "INFO~ rssidiv is configured to %f\n", loccfg.rssidiv);
     } 
 
+    conf_obj = json_object_get_object(json_value_get_object(root_val), "thread_conf");
+    if (conf_obj != NULL) {
+        val = json_object_get_value(conf_obj, "parse_workers");
+        if (val != NULL) {
+            loccfg.parse_workers = (int)json_value_get_number(val);
+            if (loccfg.parse_workers < 1)
+                loccfg.parse_workers = 1;
+            else if (loccfg.parse_workers > MAX_PARSE_WORKERS)
+                loccfg.parse_workers = MAX_PARSE_WORKERS;
+            MSG_DEBUG(LOG_INFO, "INFO~ parse_workers is configured to %d\n", loccfg.parse_workers);
+        }
+    }
+
+    conf_obj = json_object_get_object(json_value_get_object(root_val), "decoder_conf");
+    if (conf_obj != NULL) {
+        str = json_object_get_string(conf_obj, "model");
+        if (str != NULL && strcasecmp(str, "fields")) {
+            loccfg.layout = beacon_layout_find(str);
+            if (loccfg.layout == NULL)
+                MSG_DEBUG(LOG_WARNING, "WARNING~ unknown model \"%s\", use payload_fields\n", str);
+            else
+                MSG_DEBUG(LOG_INFO, "INFO~ default model is configured to %s\n", str);
+        }
+
+        serv_arry = json_object_get_array(conf_obj, "devices");
+        count = json_array_get_count(serv_arry);
+        for (i = 0; i < count; i++) {
+            serv_obj = json_array_get_object(serv_arry, i);
+            str = json_object_get_string(serv_obj, "dev_id");
+            if (str == NULL) {
+                MSG_DEBUG(LOG_WARNING, "WARNING~ device model %d has no dev_id, skip\n", i);
+                continue;
+            }
+            model_entry = lgw_malloc(sizeof(model_s));
+            model_entry->pattern = lgw_strdup(str);
+            str = json_object_get_string(serv_obj, "model");
+            if (str != NULL && strcasecmp(str, "fields")) {
+                model_entry->layout = beacon_layout_find(str);
+                if (model_entry->layout == NULL)
+                    MSG_DEBUG(LOG_WARNING, "WARNING~ unknown model \"%s\" for %s, use payload_fields\n", str, model_entry->pattern);
+            }
+            MSG_DEBUG(LOG_INFO, "INFO~ devices %s use model %s\n", model_entry->pattern,
+                    model_entry->layout ? model_entry->layout->name : "fields");
+            LGW_LIST_INSERT_TAIL(&loccfg.model_list, model_entry, list);
+        }
+    }
+
     conf_obj = json_object_get_object(json_value_get_object(root_val), "debug_conf");
     if (conf_obj == NULL) {
         MSG_DEBUG(LOG_INFO, "INFO~ %s does not contain a JSON object named debug_conf\n", conf_file);
@@ -271,142 +612,163 @@ static int parse_serv_cfg(const char * conf_file) {
         printf("INFO~ LOG_ERROR is configured to %d\n", LOG_ERROR);
     } 
 
-
-    /* start config topic info, may be have some topic, identify by topic_id */
-    /* TODO for subscribeMany */
-    /*
-	serv_arry = json_object_get_array(conf_obj, "topics");
-	if (serv_arry != NULL) {
-        count = json_array_get_count(serv_arry);
-		MSG_DEBUG(LOG_INFO, "INFO~ found %d topics", count);
-        for (i = 0; i < count, i++) {
-            serv_obj = json_array_get_object(serv_arry, i);
-            topic_entry = lgw_malloc(sizeof(topic_s));
-            topic_entry->topic_id = NULL;
-            topic_entry->topic = NULL;
-            str = json_object_get_string(serv_obj, "topic_id");
-            if (str != NULL) {
-                topic_entry->topic_id = lgw_strdup(str);
-                MSG_DEBUG(LOG_INFO, "INFO~ topic id is configured to \"%s\"\n", str);
-            } else {
-                sprintf(tmpstr, "topic_%d", i + 1);
-                topic_entry->topic_id = lgw_strdup(tmpstr);
-            }
-
-            str = json_object_get_string(serv_obj, "topic");
-            if (str != NULL) {
-                topic_entry->topic = lgw_strdup(str);
-			    MSG_DEBUG(LOG_INFO, "INFO~ topic content is configured to \"%s\"\n", str);
-            } else {
-                sprintf(tmpstr, "/topic_%d/*", i + 1);    // default topic for mqtt suscribe
-                topic_entry->topic = lgw_strdup(tmpstr);
-            }
-            LGW_LIST_INSERT_TAIL(loccfg.topic_list, topic_entry);
-        }
-
-    } else 
-        MSG_DEBUG(LOG_WARNING, "WARNING: No topic offer.\n");
-    */
 	
     /* free JSON parsing data structure */
     json_value_free(root_val);
     return 0;
 }
 
-static void connlost(void *context, char *cause)
+static int mqtt_connect(mqtt_conn_s* conn)
 {
-	MQTTAsync client = (MQTTAsync)context;
 	MQTTAsync_connectOptions conn_opts = MQTTAsync_connectOptions_initializer;
+
+	conn_opts.keepAliveInterval = DEFUALT_KEEPALIVE;
+	conn_opts.cleansession = 1;
+    conn_opts.username = loccfg.username;
+    conn_opts.password = loccfg.password;
+	conn_opts.onSuccess = onConnect;
+	conn_opts.onFailure = onConnectFailure;
+	conn_opts.context = conn;
+
+	return MQTTAsync_connect((MQTTAsync)conn->client, &conn_opts);
+}
+
+static void connlost(void *context, char *cause)
+{
+	mqtt_conn_s* conn = (mqtt_conn_s*)context;
 	int rc;
 
-	printf("\nConnection lost\n");
+	printf("\nConnection %d lost\n", conn->index);
 	if (cause)
 		printf("     cause: %s\n", cause);
 
 	printf("Reconnecting\n");
-	conn_opts.keepAliveInterval = 20;
-	conn_opts.cleansession = 1;
-	if ((rc = MQTTAsync_connect(client, &conn_opts)) != MQTTASYNC_SUCCESS)
+	conn->subscribed = 0;
+	if ((rc = mqtt_connect(conn)) != MQTTASYNC_SUCCESS)
 	{
 		printf("Failed to start connect, return code %d\n", rc);
-		finished = 1;
+		conn->finished = 1;
 	}
 }
 
 
 static int msgarrvd(void *context, char *topicName, int topicLen, MQTTAsync_message *message)
 {
-    payload_s* payload_entry = NULL;
+    payload_s payload;
+    parse_worker_s* worker;
+    topic_s* topic_entry;
 
     MSG_DEBUG(LOG_INFO, "MDEBUG~ message arrived\n");
     MSG_DEBUG(LOG_INFO, "DEBUG~  topic: %s\n", topicName);
     MSG_DEBUG(LOG_INFO, "DEBUG~  message: %.*s\n", message->payloadlen, (char*)message->payload);
 
-    payload_entry = lgw_malloc(sizeof(payload_s));
-    payload_entry->type = loccfg.serv_type;
-    payload_entry->len = message->payloadlen;
-    payload_entry->content = lgw_strdup((char*)message->payload);
+    /* choose the decoder of the subscription the topic matches */
+    topic_entry = lgw_trie_match(&topic_trie, topicName, topicLen > 0 ? (size_t)topicLen : strlen(topicName));
 
-    LGW_LIST_LOCK(&payload_list);
-    LGW_LIST_INSERT_TAIL(&payload_list, payload_entry, list);
-    LGW_LIST_UNLOCK(&payload_list);
+    /* take over the message, it is released by the parser thread */
+    payload.type = topic_entry ? topic_entry->type : loccfg.serv_type;
+    payload.len = message->payloadlen;
+    payload.content = (const char*)message->payload;
+    payload.msg = message;
 
-    sem_post(&parse_payload_sem);
+    /* same device always lands on the same worker, keep per-device ordering */
+    worker = &parse_workers[payload_shard_hash(topicName, (char*)message->payload, message->payloadlen) % loccfg.parse_workers];
+
+    if (lgw_ring_push(&worker->ring, &payload)) {
+        MSG_DEBUG(LOG_WARNING, "WARNING~ payload ring %d full, drop message (drops=%llu)\n",
+                worker->index, (unsigned long long)lgw_ring_drops(&worker->ring));
+        MQTTAsync_freeMessage(&message);
+    }
 
-    MQTTAsync_freeMessage(&message);
     MQTTAsync_free(topicName);
     return 1;
 }
 
 static void onDisconnectFailure(void* context, MQTTAsync_failureData* response)
 {
-	MSG_DEBUG(LOG_INFO, "DEBUG~ Disconnect failed, rc %s\n", MQTTAsync_strerror(response->code));
-	disc_finished = 1;
+	mqtt_conn_s* conn = (mqtt_conn_s*)context;
+	MSG_DEBUG(LOG_INFO, "DEBUG~ Disconnect %d failed, rc %s\n", conn->index, MQTTAsync_strerror(response->code));
+	conn->disc_finished = 1;
 }
 
 static void onDisconnect(void* context, MQTTAsync_successData* response)
 {
-	MSG_DEBUG(LOG_INFO, "DEBUG~ Successful disconnection\n");
-	disc_finished = 1;
+	mqtt_conn_s* conn = (mqtt_conn_s*)context;
+	MSG_DEBUG(LOG_INFO, "DEBUG~ Successful disconnection %d\n", conn->index);
+	conn->disc_finished = 1;
 }
 
 static void onSubscribe(void* context, MQTTAsync_successData* response)
 {
-	MSG_DEBUG(LOG_INFO, "DEBUG~ Subscribe succeeded\n");
-	subscribed = 1;
+	mqtt_conn_s* conn = (mqtt_conn_s*)context;
+	MSG_DEBUG(LOG_INFO, "DEBUG~ Subscribe %d succeeded\n", conn->index);
+	conn->subscribed = 1;
 }
 
 static void onSubscribeFailure(void* context, MQTTAsync_failureData* response)
 {
-	MSG_DEBUG(LOG_INFO, "DEBUG~ Subscribe failed, rc %s\n", MQTTAsync_strerror(response->code));
-	finished = 1;
+	mqtt_conn_s* conn = (mqtt_conn_s*)context;
+	MSG_DEBUG(LOG_INFO, "DEBUG~ Subscribe %d failed, rc %s\n", conn->index, MQTTAsync_strerror(response->code));
+	conn->finished = 1;
 }
 
 
 static void onConnectFailure(void* context, MQTTAsync_failureData* response)
 {
-	MSG_DEBUG(LOG_INFO, "DEBUG~ Connect failed, rc %s\n", MQTTAsync_strerror(response->code));
-	finished = 1;
+	mqtt_conn_s* conn = (mqtt_conn_s*)context;
+	MSG_DEBUG(LOG_INFO, "DEBUG~ Connect %d failed, rc %s\n", conn->index, MQTTAsync_strerror(response->code));
+	conn->finished = 1;
 }
 
 
 static void onConnect(void* context, MQTTAsync_successData* response)
 {
-	MQTTAsync client = (MQTTAsync)context;
+	mqtt_conn_s* conn = (mqtt_conn_s*)context;
 	MQTTAsync_responseOptions opts = MQTTAsync_responseOptions_initializer;
 	int rc;
 
-	MSG_DEBUG(LOG_INFO, "DEBUG~ Successful connection\n");
+    topic_s* topic_entry = NULL;
+    char** topics = NULL;
+    int* qos = NULL;
+    int count = 0;
+    int k = 0;
+
+	MSG_DEBUG(LOG_INFO, "DEBUG~ Successful connection %d\n", conn->index);
+
+    topics = lgw_malloc((loccfg.topic_list.size + 1) * sizeof(char*));
+    qos = lgw_malloc((loccfg.topic_list.size + 1) * sizeof(int));
 
-    MSG_DEBUG(LOG_INFO, "DEBUG~ Subscribing to topic %s for client %s using QoS%d\n\n", loccfg.topic, loccfg.clientid, loccfg.qos);
-    opts.onSuccess = onSubscribe;
-    opts.onFailure = onSubscribeFailure;
-    opts.context = client;
-    if ((rc = MQTTAsync_subscribe(client, loccfg.topic, loccfg.qos, &opts)) != MQTTASYNC_SUCCESS)
-    {
-        printf("Failed to start subscribe, return code %d\n", rc);
-        finished = 1;
+    /* without a shared group the topics are dealt out to the connections */
+    LGW_LIST_TRAVERSE(&loccfg.topic_list, topic_entry, list) {
+        if (loccfg.shared_group == NULL && (k++ % loccfg.connections) != conn->index)
+            continue;
+        if (loccfg.shared_group != NULL)
+            lgw_asprintf(&topics[count], "$share/%s/%s", loccfg.shared_group, topic_entry->topic);
+        else
+            topics[count] = lgw_strdup(topic_entry->topic);
+        qos[count] = topic_entry->qos;
+        MSG_DEBUG(LOG_INFO, "DEBUG~ Subscribing to topic %s for client %s using QoS%d\n", topics[count], conn->clientid, qos[count]);
+        count++;
+    }
+
+    if (count == 0) {
+        MSG_DEBUG(LOG_WARNING, "WARNING~ no topic left for connection %d, stay idle\n", conn->index);
+        conn->subscribed = 1;
+    } else {
+        opts.onSuccess = onSubscribe;
+        opts.onFailure = onSubscribeFailure;
+        opts.context = conn;
+        if ((rc = MQTTAsync_subscribeMany((MQTTAsync)conn->client, count, topics, qos, &opts)) != MQTTASYNC_SUCCESS)
+        {
+            printf("Failed to start subscribe, return code %d\n", rc);
+            conn->finished = 1;
+        }
     }
+
+    while (count > 0)
+        lgw_free(topics[--count]);
+    lgw_free(topics);
+    lgw_free(qos);
 }
 
 
@@ -414,35 +776,59 @@ static void onConnect(void* context, MQTTAsync_successData* response)
 /* --- MAIN FUNCTION -------------------------------------------------------- */
 int main(int argc, char* argv[])
 {
-    struct sigaction sigact; /* SIGQUIT&SIGINT&SIGTERM signal handling */
+    sigset_t sigmask; /* SIGQUIT&SIGINT&SIGTERM signal handling */
+    int sig_fd, stats_fd;
+    lgw_ev_s* sig_ev = NULL;
+    lgw_ev_s* stats_ev = NULL;
 
     /* configuration file related */
     char* conf_fname= "/etc/location_conf.json"; /* contain global (typ. network-wide) configuration */
 
-    curlstr_s* curl_write_data;
-
     char* url = NULL;
 
-	MQTTAsync client;
-	MQTTAsync_connectOptions conn_opts = MQTTAsync_connectOptions_initializer;
+	mqtt_conn_s* conn = NULL;
 	MQTTAsync_disconnectOptions disc_opts = MQTTAsync_disconnectOptions_initializer;
 	int rc;
+    int ready;
 	int ch;
+    int i;
 
-    pthread_t thrid_parse_payload;
     pthread_t thrid_create_place;
+    pthread_t thrid_refresh;
+    int refreshing = 0;
+
+    topic_s* topic_entry = NULL;
+
+    /* configure signal handling, the signals are blocked in every thread
+     * (threads inherit the mask) and read by the main loop through a signalfd */
+    sigemptyset(&sigmask);
+    sigaddset(&sigmask, SIGQUIT); /* Ctrl-\ */
+    sigaddset(&sigmask, SIGINT); /* Ctrl-C */
+    sigaddset(&sigmask, SIGTERM); /* default "kill" command */
+    pthread_sigmask(SIG_BLOCK, &sigmask, NULL);
+
+    if (lgw_evloop_init(&main_loop)) {
+        printf("ERROR~ can't create main event loop, exit!\n");
+        exit(EXIT_FAILURE);
+    }
 
-    /* configure signal handling */
-    sigemptyset(&sigact.sa_mask);
-    sigact.sa_flags = 0;
-    sigact.sa_handler = sig_handler;
-    sigaction(SIGQUIT, &sigact, NULL); /* Ctrl-\ */
-    sigaction(SIGINT, &sigact, NULL); /* Ctrl-C */
-    sigaction(SIGTERM, &sigact, NULL); /* default "kill" command */
+    sig_fd = lgw_signalfd_create(&sigmask);
+    if (sig_fd < 0 || (sig_ev = lgw_evloop_add(&main_loop, sig_fd, EPOLLIN, on_signal, NULL)) == NULL) {
+        printf("ERROR~ can't watch signals, exit!\n");
+        exit(EXIT_FAILURE);
+    }
 
-    sem_init(&parse_payload_sem, 0, 0);
+    inode_efd = lgw_eventfd_create();
+    if (inode_efd < 0) {
+        printf("ERROR~ can't create create place doorbell, exit!\n");
+        exit(EXIT_FAILURE);
+    }
 
-    sem_init(&parse_inode_sem, 0, 0);
+    refresh_efd = lgw_eventfd_create();
+    if (refresh_efd < 0) {
+        printf("ERROR~ can't create beacon refresh doorbell, exit!\n");
+        exit(EXIT_FAILURE);
+    }
 
     printf("DEBUG~ starting location service!\n");
 
@@ -456,27 +842,38 @@ int main(int argc, char* argv[])
 		exit(EXIT_FAILURE);
     }
 
-    MSG_DEBUG(LOG_INFO, "DEBUG~ getting placetype...!\n");
-
-    curl_write_data = init_curl_write_data();
-
-    mapwize_get_placetype(loccfg.apikey, loccfg.orgid, (void*)curl_write_data);  //sercfg.placetypeid 
+    lgw_trie_init(&topic_trie);
+    LGW_LIST_TRAVERSE(&loccfg.topic_list, topic_entry, list) {
+        if (lgw_trie_insert(&topic_trie, topic_entry->topic, topic_entry))
+            MSG_DEBUG(LOG_WARNING, "WARNING~ invalid topic filter \"%s\"\n", topic_entry->topic);
+    }
 
-    get_placetype(curl_write_data);
+    mapwize_arena = json_arena_new(0);
+    if (mapwize_arena == NULL) {
+        printf("ERROR~ can't allocate the mapwize arena, EXIT ERROR!\n");
+        exit(EXIT_FAILURE);
+    }
 
-    lgw_free(curl_write_data->ptr);
-    lgw_free(curl_write_data);
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    if (mapwize_client_init(&mapwize_client, loccfg.window)) {
+        printf("ERROR~ can't create the mapwize client, EXIT ERROR!\n");
+        exit(EXIT_FAILURE);
+    }
 
-    curl_write_data = init_curl_write_data();
+    lgw_epoch_init(&beacon_epoch);
 
-    mapwize_get_beacons(loccfg.apikey, (void*)curl_write_data);  // ibeacon_list  
+    /* start on the snapshot of the last run, mapwize is asked in the background */
+    if (load_snapshot() == 0)
+        beacons_stale = 1;
+    else {
+        MSG_DEBUG(LOG_INFO, "DEBUG~ getting placetype...!\n");
 
-    get_beacons(curl_write_data);
+        load_placetype();
 
-    lgw_free(curl_write_data->ptr);
-    lgw_free(curl_write_data);
+        load_beacons();     // beacon_snap
 
-    MSG_DEBUG(LOG_INFO, "DEBUG~ getting beacons Done!\n");
+        MSG_DEBUG(LOG_INFO, "DEBUG~ getting beacons Done!\n");
+    }
 
     if (NULL != loccfg.connection)
         url = loccfg.connection;
@@ -485,217 +882,272 @@ int main(int argc, char* argv[])
         snprintf(url, DEFAULT_URL_LEN, "tcp://%s:%d", loccfg.servaddr, loccfg.servport);
     }
 
-    MSG_DEBUG(LOG_INFO, "DEBUG~ create parse payload thread...\n");
-    if (lgw_pthread_create(&thrid_parse_payload, NULL, (void *(*)(void *))thread_parse_payload, NULL))
-        MSG_DEBUG(LOG_INFO, "DEBUG~ ERROR, Can't create thread of parse payload");
+    parse_workers = lgw_malloc(loccfg.parse_workers * sizeof(parse_worker_s));
+    if (parse_workers == NULL) {
+        printf("ERROR~ can't allocate parse workers, exit!\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (i = 0; i < loccfg.parse_workers; i++) {
+        parse_workers[i].index = i;
+        if (lgw_ring_init(&parse_workers[i].ring, DEFAULT_PAYLOAD_RING, sizeof(payload_s))) {
+            printf("ERROR~ can't allocate payload ring, exit!\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (i = 0; i < loccfg.parse_workers; i++) {
+        MSG_DEBUG(LOG_INFO, "DEBUG~ create parse payload thread %d...\n", i);
+        if (lgw_pthread_create(&parse_workers[i].thrid, NULL, thread_parse_payload, &parse_workers[i]))
+            MSG_DEBUG(LOG_INFO, "DEBUG~ ERROR, Can't create thread of parse payload");
+    }
+
+    stats_fd = lgw_timerfd_create(DEFAULT_STATS_MS);
+    if (stats_fd >= 0)
+        stats_ev = lgw_evloop_add(&main_loop, stats_fd, EPOLLIN, on_stats_timer, NULL);
 
     MSG_DEBUG(LOG_INFO, "DEBUG~ create create place thread...\n");
     if (lgw_pthread_create(&thrid_create_place, NULL, (void *(*)(void *))thread_create_place, NULL))
         MSG_DEBUG(LOG_INFO, "DEBUG~ ERROR, Can't create thread of create place");
 
-    MSG_DEBUG(LOG_INFO, "DEBUG~ create mqtt connection: %s\n", url);
-
-	if ((rc = MQTTAsync_create(&client, url, loccfg.clientid, MQTTCLIENT_PERSISTENCE_NONE, NULL))
-			!= MQTTASYNC_SUCCESS)
-	{
-		printf("Failed to create client, return code %s\n", MQTTAsync_strerror(rc));
-		rc = EXIT_FAILURE;
-		goto destroy_exit;
-	}
+    if (loccfg.beacon_refresh > 0 || beacons_stale) {
+        MSG_DEBUG(LOG_INFO, "DEBUG~ create beacon refresh thread, every %d seconds...\n", loccfg.beacon_refresh);
+        if (lgw_pthread_create(&thrid_refresh, NULL, (void *(*)(void *))thread_refresh_beacons, NULL))
+            MSG_DEBUG(LOG_INFO, "DEBUG~ ERROR, Can't create thread of beacon refresh");
+        else
+            refreshing = 1;
+    }
 
-    MSG_DEBUG(LOG_INFO, "DEBUG~ create mqtt callbacks\n");
+    mqtt_conns = lgw_malloc(loccfg.connections * sizeof(mqtt_conn_s));
+    if (mqtt_conns == NULL) {
+        printf("ERROR~ can't allocate mqtt connections, exit!\n");
+        exit(EXIT_FAILURE);
+    }
 
-	if ((rc = MQTTAsync_setCallbacks(client, client, connlost, msgarrvd, NULL)) != MQTTASYNC_SUCCESS)
-	{
-		printf("Failed to set callbacks, return code %s\n", MQTTAsync_strerror(rc));
-		rc = EXIT_FAILURE;
-		goto destroy_exit;
-	}
+    for (i = 0; i < loccfg.connections; i++) {
+        conn = &mqtt_conns[i];
+        conn->index = i;
+        if (loccfg.connections > 1)
+            lgw_asprintf(&conn->clientid, "%s_%d", loccfg.clientid, i);   // client ids must be unique
+        else
+            conn->clientid = lgw_strdup(loccfg.clientid);
+
+        MSG_DEBUG(LOG_INFO, "DEBUG~ create mqtt connection %d: %s\n", i, url);
+
+        if ((rc = MQTTAsync_create((MQTTAsync*)&conn->client, url, conn->clientid, MQTTCLIENT_PERSISTENCE_NONE, NULL))
+                != MQTTASYNC_SUCCESS)
+        {
+            printf("Failed to create client, return code %s\n", MQTTAsync_strerror(rc));
+            rc = EXIT_FAILURE;
+            goto destroy_exit;
+        }
 
-	conn_opts.keepAliveInterval = DEFUALT_KEEPALIVE;
-	conn_opts.cleansession = 1;
-    conn_opts.username = loccfg.username;
-    conn_opts.password = loccfg.password;
-	conn_opts.onSuccess = onConnect;
-	conn_opts.onFailure = onConnectFailure;
-	conn_opts.context = client;
+        MSG_DEBUG(LOG_INFO, "DEBUG~ create mqtt callbacks\n");
 
-    MSG_DEBUG(LOG_INFO, "DEBUG~ staring connect mqtt server\n");
+        if ((rc = MQTTAsync_setCallbacks((MQTTAsync)conn->client, conn, connlost, msgarrvd, NULL)) != MQTTASYNC_SUCCESS)
+        {
+            printf("Failed to set callbacks, return code %s\n", MQTTAsync_strerror(rc));
+            rc = EXIT_FAILURE;
+            goto destroy_exit;
+        }
 
-	if ((rc = MQTTAsync_connect(client, &conn_opts)) != MQTTASYNC_SUCCESS)
-	{
-		printf("Failed to start connect, return code %s\n", MQTTAsync_strerror(rc));
-		rc = EXIT_FAILURE;
-		goto destroy_exit;
-	}
+        MSG_DEBUG(LOG_INFO, "DEBUG~ staring connect mqtt server\n");
 
-	while (!subscribed && !finished) {
-	    usleep(TIMEOUT);
+        if ((rc = mqtt_connect(conn)) != MQTTASYNC_SUCCESS)
+        {
+            printf("Failed to start connect, return code %s\n", MQTTAsync_strerror(rc));
+            rc = EXIT_FAILURE;
+            goto destroy_exit;
+        }
     }
 
-	if (finished)
-		goto destroy_exit;
+    do {
+        lgw_evloop_run(&main_loop, TIMEOUT / 1000);
+        for (i = 0, ready = 0; i < loccfg.connections; i++) {
+            if (mqtt_conns[i].finished)
+                goto destroy_exit;
+            ready += mqtt_conns[i].subscribed;
+        }
+    } while (ready < loccfg.connections && !exit_sig && !quit_sig);
 
     MSG_DEBUG(LOG_INFO, "DEBUG~  subscribing mqtt message\n");
 
-    while (!exit_sig && !quit_sig) {  // main thread for subscribe
+    while (!exit_sig && !quit_sig) {  // main thread for subscribe, sleeps until a signal or timer fires
+        lgw_evloop_run(&main_loop, -1);
 	}  
 
 	disc_opts.onSuccess = onDisconnect;
 	disc_opts.onFailure = onDisconnectFailure;
-	if ((rc = MQTTAsync_disconnect(client, &disc_opts)) != MQTTASYNC_SUCCESS)
-	{
-		printf("Failed to start disconnect, return code %s\n", MQTTAsync_strerror(rc));
-		rc = EXIT_FAILURE;
-		goto destroy_exit;
-	}
- 	while (!disc_finished)
- 	{
-		usleep(10000L);
- 	}
-
-    sem_post(&parse_payload_sem);
-    sem_post(&parse_inode_sem);
-    pthread_join(thrid_parse_payload, NULL);
+    for (i = 0; i < loccfg.connections; i++) {
+        disc_opts.context = &mqtt_conns[i];
+        if ((rc = MQTTAsync_disconnect((MQTTAsync)mqtt_conns[i].client, &disc_opts)) != MQTTASYNC_SUCCESS)
+        {
+            printf("Failed to start disconnect, return code %s\n", MQTTAsync_strerror(rc));
+            mqtt_conns[i].disc_finished = 1;
+        }
+    }
+    for (i = 0; i < loccfg.connections; i++) {
+        while (!mqtt_conns[i].disc_finished)
+            usleep(10000L);
+    }
+
+    for (i = 0; i < loccfg.parse_workers; i++)
+        lgw_ring_wakeup(&parse_workers[i].ring);
+    lgw_eventfd_post(inode_efd);
+    for (i = 0; i < loccfg.parse_workers; i++)
+        pthread_join(parse_workers[i].thrid, NULL);
     pthread_join(thrid_create_place, NULL);
+    if (refreshing) {
+        lgw_eventfd_post(refresh_efd);
+        pthread_join(thrid_refresh, NULL);
+    }
+
+    for (i = 0; i < loccfg.parse_workers; i++)
+        lgw_ring_destroy(&parse_workers[i].ring);
+    lgw_free(parse_workers);
+    free_device_table();
+    free_beacon_reg(beacon_snap);
+    beacon_snap = NULL;
+    lgw_epoch_destroy(&beacon_epoch);
+    mapwize_client_destroy(&mapwize_client);
+    curl_global_cleanup();
+    free_place_table();
 
 destroy_exit:
-	MQTTAsync_destroy(&client);
+    for (i = 0; mqtt_conns != NULL && i < loccfg.connections; i++) {
+        if (mqtt_conns[i].client != NULL)
+            MQTTAsync_destroy((MQTTAsync*)&mqtt_conns[i].client);
+        lgw_free(mqtt_conns[i].clientid);
+    }
+    lgw_free(mqtt_conns);
+    lgw_evloop_del(&main_loop, stats_ev);
+    lgw_evloop_del(&main_loop, sig_ev);
+    lgw_evloop_destroy(&main_loop);
+    lgw_trie_free(&topic_trie);
+    json_arena_free(mapwize_arena);
     free_cfg_entry(&loccfg);
  	return rc;
 }
 
 
-static void thread_parse_payload() 
+static void* thread_parse_payload(void* arg) 
 {
-    /* JSON parsing variables */
-    JSON_Value *root_val;
-    JSON_Object *mqtt_obj = NULL;
-    JSON_Object *payload_obj = NULL;
-    JSON_Value *val = NULL; /* needed to detect the absence of some fields */
-    const char *str; /* pointer to sub-strings in the JSON data */
+    parse_worker_s* worker = (parse_worker_s*)arg;
+
+    /* JSON scanning variables */
+    json_scan_s ttn_scan;
+    json_scan_value_s fields[TTN_FIELD_COUNT];
+    const beacon_layout_s* layout;
 
+    payload_s batch[DEFAULT_PAYLOAD_BATCH];
     payload_s* payload_entry = NULL;
     inode_s* inode_entry = NULL;
 
+    size_t i, count;
+
     bool parse_ok;
 
+    json_scan_compile(&ttn_scan, ttn_paths, TTN_FIELD_COUNT);
+
     while (!exit_sig && !quit_sig) {
-        lgw_wait_sem(&parse_payload_sem, DEFAULT_LOOP_MS); // every 10 seconds
+        if (lgw_ring_wait(&worker->ring, DEFAULT_LOOP_MS)) // every 10 seconds
+            continue;
 
-        MSG_DEBUG(LOG_INFO, "DEBUG~ parse payload thread trigger parse...\n");
+        count = lgw_ring_drain(&worker->ring, batch, DEFAULT_PAYLOAD_BATCH);
 
-        LGW_LIST_LOCK(&payload_list);
-        LGW_LIST_TRAVERSE_SAFE_BEGIN(&payload_list, payload_entry, list) {
-            if (payload_entry) {
-                LGW_LIST_REMOVE_CURRENT(list);
-                break;
-            }
-        }
-        LGW_LIST_TRAVERSE_SAFE_END;
-        LGW_LIST_UNLOCK(&payload_list);
+        MSG_DEBUG(LOG_INFO, "DEBUG~ parse payload thread %d trigger parse %zu payloads (depth=%zu, drops=%llu)...\n",
+                worker->index, count, lgw_ring_depth(&worker->ring), (unsigned long long)lgw_ring_drops(&worker->ring));
 
-        if (payload_entry == NULL) continue;
+        for (i = 0; i < count; i++) {
+            payload_entry = &batch[i];
 
-        MSG_DEBUG(LOG_INFO, "DEBUG~ payload(%d): %s\n",
-                payload_entry->type,
-                payload_entry->content);
+            MSG_DEBUG(LOG_INFO, "DEBUG~ payload(%d): %.*s\n",
+                    payload_entry->type,
+                    payload_entry->len, payload_entry->content);
         
-        inode_entry = (inode_s*)lgw_malloc(sizeof(inode_s));
-
-        inode_entry->type = iBEACON;
-
-        parse_ok = true;
-
-        switch (payload_entry->type) {
-            case TTN:
-                root_val = json_parse_string_with_comments((const char*)payload_entry->content);
-                if (root_val == NULL) {
-                    MSG_DEBUG(LOG_WARNING, "WARNING~ receive invalid JSON,  aborted\n");
-                    parse_ok = false;
-                    break;
-                }
-                str = json_object_get_string(json_value_get_object(root_val), "dev_id");
-                if (str != NULL) {
-                    inode_entry->devid = lgw_strdup(str);
-                } else {
-                    MSG_DEBUG(LOG_WARNING, "WARNING~ can't get device id \n");
-                    parse_ok = false;
-                    break;
-                }
-                str = json_object_get_string(json_value_get_object(root_val), "hardware_serial");
-                if (str != NULL) {
-                    inode_entry->deveui = lgw_strdup(str);
-                } else {
-                    MSG_DEBUG(LOG_WARNING, "WARNING~ can't get deveui id \n");
-                    parse_ok = false;
-                    break;
-                }
-                payload_obj = json_object_get_object(json_value_get_object(root_val), "payload_fields");
-                if (payload_obj == NULL) {
-                    MSG_DEBUG(LOG_INFO, "INFO~ does not contain a JSON object named payload_fields\n");
-                    parse_ok = false;
-                    break;
-                }
-
-                str = json_object_get_string(payload_obj, "UUID");
-                if (str != NULL) {
-                    inode_entry->uuid = lgw_strdup(str);
-                } else {
-                    MSG_DEBUG(LOG_WARNING, "WARNING~ can't get uuid, drop the payload\n");
-                    parse_ok = false;
-                    break;
-                }
-
-                val = json_object_get_value(payload_obj, "MAJOR");
-                if (str != NULL) {
-                    inode_entry->major = (int)json_value_get_number(val);
-                } else {
-                    MSG_DEBUG(LOG_WARNING, "WARNING~ can't get major id, drop the payload\n");
-                    parse_ok = false;
-                    break;
-                }
+            inode_entry = (inode_s*)lgw_malloc(sizeof(inode_s));
+
+            inode_entry->type = iBEACON;
+
+            parse_ok = true;
+
+            switch (payload_entry->type) {
+                case TTN:
+                    if (json_scan(&ttn_scan, payload_entry->content, payload_entry->len, fields) < 0) {
+                        MSG_DEBUG(LOG_WARNING, "WARNING~ receive invalid JSON,  aborted\n");
+                        parse_ok = false;
+                        break;
+                    }
+                    if ((inode_entry->devid = scan_strdup(&fields[TTN_DEV_ID])) == NULL) {
+                        MSG_DEBUG(LOG_WARNING, "WARNING~ can't get device id \n");
+                        parse_ok = false;
+                        break;
+                    }
+                    if ((inode_entry->deveui = scan_strdup(&fields[TTN_HARDWARE_SERIAL])) == NULL) {
+                        MSG_DEBUG(LOG_WARNING, "WARNING~ can't get deveui id \n");
+                        parse_ok = false;
+                        break;
+                    }
+                    if ((layout = get_device_layout(inode_entry->devid)) != NULL) {
+                        if (decode_raw_beacons(inode_entry, layout, &fields[TTN_PAYLOAD_RAW]))
+                            parse_ok = false;
+                        break;
+                    }
+                    if (fields[TTN_PAYLOAD_FIELDS].type != JSON_SCAN_OBJECT) {
+                        MSG_DEBUG(LOG_INFO, "INFO~ does not contain a JSON object named payload_fields\n");
+                        parse_ok = false;
+                        break;
+                    }
+
+                    if ((inode_entry->uuid = scan_strdup(&fields[TTN_UUID])) == NULL) {
+                        MSG_DEBUG(LOG_WARNING, "WARNING~ can't get uuid, drop the payload\n");
+                        parse_ok = false;
+                        break;
+                    }
+
+                    if (fields[TTN_MAJOR].type != JSON_SCAN_NONE) {
+                        inode_entry->major = (int)json_scan_get_number(&fields[TTN_MAJOR]);
+                    } else {
+                        MSG_DEBUG(LOG_WARNING, "WARNING~ can't get major id, drop the payload\n");
+                        parse_ok = false;
+                        break;
+                    }
+
+                    if (fields[TTN_MINOR].type != JSON_SCAN_NONE) {
+                        inode_entry->minor = (int)json_scan_get_number(&fields[TTN_MINOR]);
+                    } else {
+                        MSG_DEBUG(LOG_WARNING, "WARNING~ can't get minor id, drop the payload\n");
+                        parse_ok = false;
+                        break;
+                    }
+
+                    if (fields[TTN_RSSI].type != JSON_SCAN_NONE) {
+                        inode_entry->rssi = (int)json_scan_get_number(&fields[TTN_RSSI]);
+                        inode_entry->dist = calc_dist_byrssi(inode_entry->rssi, loccfg.rssirate, loccfg.rssidiv);
+                        MSG_DEBUG(LOG_INFO, "INFO~ get rssi from message %d\n", inode_entry->rssi);
+                    } else {
+                        MSG_DEBUG(LOG_WARNING, "WARNING~ can't get rssi, drop the payload\n");
+                        parse_ok = false;
+                        break;
+                    }
 
-                val = json_object_get_value(payload_obj, "MINOR");
-                if (val != NULL) {
-                    inode_entry->minor = (int)json_value_get_number(val);
-                } else {
-                    MSG_DEBUG(LOG_WARNING, "WARNING~ can't get minor id, drop the payload\n");
-                    parse_ok = false;
                     break;
-                }
-
-                val = json_object_get_value(payload_obj, "RSSI");
-                if (val != NULL) {
-                    inode_entry->rssi = (int)json_value_get_number(val);
-                    inode_entry->dist = calc_dist_byrssi(inode_entry->rssi, loccfg.rssirate, loccfg.rssidiv);
-                    MSG_DEBUG(LOG_INFO, "INFO~ get rssi from message %d\n", inode_entry->rssi);
-                } else {
-                    MSG_DEBUG(LOG_WARNING, "WARNING~ can't get rssi, drop the payload\n");
-                    parse_ok = false;
+                default:
                     break;
-                }
+            }
 
-                break;
-            default:
-                break;
-        }
+            if (parse_ok) {
+                update_device(inode_entry);
+            } else {
+                MSG_DEBUG(LOG_INFO, "DEBUG~ Failed to parse a payload, skip to next!\n");
+                free_inode_entry(inode_entry);
+            }
 
-        if (parse_ok) {
-            LGW_LIST_LOCK(&inode_list);
-            LGW_LIST_INSERT_TAIL(&inode_list, inode_entry, list);
-            sem_post(&parse_inode_sem);
-            LGW_LIST_UNLOCK(&inode_list);
-        } else {
-            MSG_DEBUG(LOG_INFO, "DEBUG~ Failed to parse a payload, skip to next!\n");
-            free_inode_entry(inode_entry);
+            free_payload_entry(payload_entry);
         }
-
-        lgw_free(payload_entry->content);
-        lgw_free(payload_entry);
-
-        json_value_free(root_val);
     }
+
+    return NULL;
 }
 
 static void thread_create_place() 
@@ -704,60 +1156,586 @@ static void thread_create_place()
     char place_id[25] = {0};
     char place_data[1024] = {0};
 
+    inode_s* batch = NULL;
     inode_s* inode_entry = NULL;
-    ibeacon_s* ibeacon_entry = NULL;
+    beacon_reg_s* reg = NULL;
+    place_state_s state;
+    uint64_t now, due, next_reconcile = 0, next_expire = 0;
+    int i, count, row, len = 0;
+    int reader, wait;
+
+    reader = lgw_epoch_register(&beacon_epoch);
+    if (reader < 0) {
+        MSG_DEBUG(LOG_ERROR, "ERROR~ too many beacon readers, create place thread exit!\n");
+        return;
+    }
+
+    list_places();      // the acknowledged state
 
     while (!exit_sig && !quit_sig) {
-        lgw_wait_sem(&parse_inode_sem, DEFAULT_LOOP_MS); // every 10 seconds
-        MSG_DEBUG(LOG_INFO, "DEBUG~  Trigger create place thread...\n");
-        LGW_LIST_LOCK(&inode_list);
-        LGW_LIST_TRAVERSE_SAFE_BEGIN(&inode_list, inode_entry, list) {
-            if (inode_entry) {
-                LGW_LIST_REMOVE_CURRENT(list);
-                break;
-            }
+        /* the requests in flight move on and complete while waiting for the doorbell or the next reconcile */
+        now = place_now();
+        wait = DEFAULT_LOOP_MS;     // every 10 seconds
+        if (place_queue != NULL && mapwize_client_inflight(&mapwize_client) < mapwize_client.window) {
+            due = next_reconcile > place_due ? next_reconcile : place_due;
+            if (due <= now)
+                wait = 0;
+            else if (due - now < (uint64_t)wait)
+                wait = (int)(due - now);
         }
-        LGW_LIST_TRAVERSE_SAFE_END;
-        LGW_LIST_UNLOCK(&inode_list);
-
-        if (inode_entry == NULL) continue;
+        if (mapwize_client_run(&mapwize_client, inode_efd, wait))
+            lgw_eventfd_take(inode_efd);
+
+        count = take_dirty_devices(&batch);
+
+        if (count > 0)
+            MSG_DEBUG(LOG_INFO, "DEBUG~  Trigger create place thread, %d devices, %d in flight (coalesced=%llu)...\n",
+                    count, mapwize_client_inflight(&mapwize_client),
+                    (unsigned long long)__atomic_load_n(&coalesced, __ATOMIC_RELAXED));
+
+        /* a reading only changes the desired state, the reconciler sends what differs */
+        while ((inode_entry = batch) != NULL) {
+            batch = inode_entry->list.next;
+
+            MSG_DEBUG(LOG_INFO, "DEBUG~ CreateplaceData deveui = %s, devid = %s \n", inode_entry->deveui, inode_entry->devid);
+
+            /* the strongest beacon known to mapwize gives the position,
+             * the registry can be replaced at any time, only use it inside the epoch */
+            lgw_epoch_enter(&beacon_epoch, reader);
+            reg = __atomic_load_n(&beacon_snap, __ATOMIC_SEQ_CST);
+
+            row = find_beacon(reg, inode_entry->uuid, inode_entry->major, inode_entry->minor);
+            for (i = 0; row < 0 && i < inode_entry->nreads; i++)
+                row = find_beacon(reg, inode_entry->reads[i].uuid, inode_entry->reads[i].major, inode_entry->reads[i].minor);
+
+            if (row >= 0) {
+                snprintf(place_id, sizeof(place_id), PLACE_ID_PREFIX "%s", inode_entry->deveui);
+                len = write_place(place_data, sizeof(place_data), inode_entry, place_id,
+                        beacon_reg_str(reg, reg->place_tail[row]), reg->place_tail_len[row]);
+                state.floor = reg->floor[row];
+                state.lat = reg->lat[row];
+                state.lon = reg->lon[row];
+            }
 
-        MSG_DEBUG(LOG_INFO, "DEBUG~ CreateplaceData deveui = %s, devid = %s \n", inode_entry->deveui, inode_entry->devid);
+            lgw_epoch_exit(&beacon_epoch, reader);
 
-        LGW_LIST_TRAVERSE(&ibeacon_list, ibeacon_entry, list) {
-            if (inode_entry->minor != ibeacon_entry->minor) {
-                continue;
-            } else if (inode_entry->major != ibeacon_entry->major) {
-                continue;
-            } else if (strncmp(inode_entry->uuid, ibeacon_entry->uuid, 12)) {   // compare tail of uuid (12 char)
-                continue;
-            } else {
-                snprintf(place_id, sizeof(place_id), "7f9abcd9%s", inode_entry->deveui);
-                snprintf(place_data, sizeof(place_data), 
-                        "{\"name\":\"%s\",\"description\":\"moveable place point (%s)\",\"floor\":%d,\"geometry\":{\"type\":\"Point\",\"coordinates\":[%.15lf,%.15lf]},\"_id\":\"%s\", \"universes\":\"%s\", \"placeTypeId\":\"%s\",\"isPublished\":true,\"isSearchable\":true,\"isVisible\":true,\"isClickable\":true,\"searchKeywords\":\"%s\", \"translations\":[{\"title\":\"%s\",\"language\":\"en\"}], \"venueId\":\"%s\",\"owner\":\"%s\"}",
-                        inode_entry->devid, inode_entry->deveui, ibeacon_entry->floor, // floor
-                        ibeacon_entry->gps.lon, ibeacon_entry->gps.lat,        // location
-                        place_id, loccfg.universesid,loccfg.placetypeid,       //placetypeid
-                        inode_entry->devid, inode_entry->devid,                //title
-                        ibeacon_entry->venueid, ibeacon_entry->orgid);
-                MSG_DEBUG(LOG_INFO, "DEBUG~ CreateplaceData: %s \n", place_data);
-                mapwize_del_places(loccfg.apikey, place_id);    // delete the duplicate place if exist
-                mapwize_create_place(loccfg.apikey, place_data);
-                break;
+            if (row >= 0) {
+                if (len < 0) {
+                    MSG_DEBUG(LOG_WARNING, "WARNING~ place of %s doesn't fit in %zu bytes, skip!\n", inode_entry->devid, sizeof(place_data));
+                } else {
+                    MSG_DEBUG(LOG_INFO, "DEBUG~ CreateplaceData: %s \n", place_data);
+                    want_place(place_id, &state, place_data, len);
+                }
             }
+
+            free_inode_entry(inode_entry);
         }
 
-        free_inode_entry(inode_entry);
+        now = place_now();
+        if (loccfg.place_ttl > 0 && now >= next_expire) {
+            expire_places(now);
+            next_expire = now + DEFAULT_LOOP_MS;
+        }
+        if (place_queue != NULL && now >= next_reconcile && now >= place_due &&
+                mapwize_client_inflight(&mapwize_client) < mapwize_client.window) {
+            reconcile_places(now);
+            next_reconcile = now + loccfg.reconcile_ms;
+        }
     }
+
+    /* let the requests in flight complete, the client drops what is left */
+    for (i = 0; i < (int)(DEFAULT_LOOP_MS / 100) && mapwize_client_inflight(&mapwize_client) > 0; i++)
+        mapwize_client_run(&mapwize_client, -1, 100);
 }
 
+static uint64_t place_now(void)
+{
+    struct timespec ts;
 
-/*!
- * \brief calc distance between node and gw, formula: d = 10^((abs(RSSI) - A) / (10 * n)) 
- * \param rate the rssi of the distance of 1 meter, default (45-49)?
- * \param div attenuation, default 2.0?
- * \retval distance
- */
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* same floor and same point, within the rounding of a round trip through mapwize */
+static bool same_place_state(const place_state_s* a, const place_state_s* b)
+{
+    return a->floor == b->floor && fabs(a->lat - b->lat) < PLACE_STATE_EPS && fabs(a->lon - b->lon) < PLACE_STATE_EPS;
+}
+
+/* the place has a request to send: created, moved or deleted */
+static bool place_differs(const pnode_s* place)
+{
+    if (place->wanted)
+        return !place->exists || !same_place_state(&place->desired, &place->acked);
+    return place->exists;
+}
+
+/* the place of an id, added on first use */
+static pnode_s* get_place(const char* place_id)
+{
+    pnode_s* pnode;
+    uint32_t bucket;
+
+    bucket = lgw_str_hash(place_id, strlen(place_id)) & (DEVICE_HASH_SIZE - 1);
+
+    for (pnode = place_table[bucket]; pnode != NULL; pnode = pnode->hnext) {
+        if (!strcmp(pnode->place_id, place_id))
+            return pnode;
+    }
+
+    pnode = (pnode_s*)lgw_malloc(sizeof(pnode_s));
+    if (pnode == NULL)
+        return NULL;
+    snprintf(pnode->place_id, sizeof(pnode->place_id), "%s", place_id);
+    pnode->hnext = place_table[bucket];
+    place_table[bucket] = pnode;
+
+    return pnode;
+}
+
+static void free_place_table(void)
+{
+    pnode_s* pnode;
+    int i;
+
+    for (i = 0; i < DEVICE_HASH_SIZE; i++) {
+        while ((pnode = place_table[i]) != NULL) {
+            place_table[i] = pnode->hnext;
+            lgw_free(pnode->doc);
+            lgw_free(pnode);
+        }
+    }
+    place_queue = place_queue_tail = NULL;
+}
+
+static void queue_place(pnode_s* place)
+{
+    if (place->queued)
+        return;
+    place->queued = 1;
+    place->qnext = NULL;
+    if (place_queue == NULL || place->retry < place_due)
+        place_due = place->retry;
+    if (place_queue_tail != NULL)
+        place_queue_tail->qnext = place;
+    else
+        place_queue = place;
+    place_queue_tail = place;
+}
+
+/* set the desired state of the place of a device, queued for the reconciler if it moved */
+static int want_place(const char* place_id, const place_state_s* state, const char* data, int len)
+{
+    pnode_s* place;
+    char* doc;
+
+    place = get_place(place_id);
+    if (place == NULL)
+        return -1;
+
+    place->seen = place_now();
+
+    if (place->wanted && same_place_state(&place->desired, state)) {
+        __atomic_add_fetch(&unchanged, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+
+    doc = lgw_strndup(data, len);
+    if (doc == NULL)
+        return -1;
+    lgw_free(place->doc);
+    place->doc = doc;
+    place->desired = *state;
+    place->wanted = 1;
+
+    if (place->stage == PLACE_IDLE && place_differs(place))
+        queue_place(place);
+
+    return 0;
+}
+
+/* the devices not seen for place_ttl seconds lose their place, the forgotten places are freed */
+static void expire_places(uint64_t now)
+{
+    pnode_s** link;
+    pnode_s* place;
+    int i;
+
+    for (i = 0; i < DEVICE_HASH_SIZE; i++) {
+        link = &place_table[i];
+        while ((place = *link) != NULL) {
+            if ((place->wanted || place->exists) && now - place->seen > (uint64_t)loccfg.place_ttl * 1000) {
+                place->wanted = 0;
+                lgw_free(place->doc);
+                place->doc = NULL;
+                if (place->stage == PLACE_IDLE && place_differs(place))
+                    queue_place(place);
+            }
+            if (!place->wanted && !place->exists && !place->queued && place->stage == PLACE_IDLE) {
+                *link = place->hnext;
+                lgw_free(place);
+                continue;
+            }
+            link = &place->hnext;
+        }
+    }
+}
+
+/* send the difference between the desired and the acknowledged state of the queued places, as the window allows */
+static void reconcile_places(uint64_t now)
+{
+    pnode_s* place;
+    pnode_s* retry = NULL;
+    pnode_s* retry_tail = NULL;
+    uint64_t due = UINT64_MAX;
+    int rc = 0;
+
+    while ((place = place_queue) != NULL) {
+        if (place->stage != PLACE_IDLE || !place_differs(place)) {
+            place_queue = place->qnext;     // in flight, requeued when done; or nothing to send
+            place->queued = 0;
+            continue;
+        }
+
+        if (place->retry <= now) {
+            place->sending = place->desired;
+            if (!place->wanted) {
+                rc = mapwize_del_places_async(&mapwize_client, loccfg.apikey, place->place_id, on_place_done, place);
+                place->stage = PLACE_DELETING;
+            } else if (!place->exists && places_listed) {
+                rc = mapwize_create_place_async(&mapwize_client, loccfg.apikey, place->doc, on_place_done, place);
+                place->stage = PLACE_CREATING;
+            } else {    // moved, or not listed: updated, created on a 404
+                rc = mapwize_update_place_async(&mapwize_client, loccfg.apikey, place->place_id, place->doc, on_place_done, place);
+                place->stage = PLACE_UPDATING;
+            }
+
+            if (rc > 0) {
+                place->stage = PLACE_IDLE;      // the window is full, the rest waits for a completion
+                break;
+            }
+
+            if (rc == 0) {
+                place_queue = place->qnext;
+                place->queued = 0;
+                continue;
+            }
+
+            MSG_DEBUG(LOG_WARNING, "WARNING~ can't send the place %s, retry later\n", place->place_id);
+            place->stage = PLACE_IDLE;
+            place->retry = now + DEFAULT_LOOP_MS;
+        }
+
+        /* failed lately, kept aside for a later pass, still queued */
+        place_queue = place->qnext;
+        place->qnext = NULL;
+        if (retry_tail != NULL)
+            retry_tail->qnext = place;
+        else
+            retry = place;
+        retry_tail = place;
+        if (place->retry < due)
+            due = place->retry;
+    }
+
+    if (place_queue == NULL)
+        place_queue_tail = NULL;
+
+    /* the places failed lately go after the others */
+    if (retry != NULL) {
+        if (place_queue_tail != NULL)
+            place_queue_tail->qnext = retry;
+        else
+            place_queue = retry;
+        place_queue_tail = retry_tail;
+    }
+
+    /* a full window leaves places ready to send, else the queue only holds the places failed lately */
+    place_due = rc > 0 ? now : due;
+}
+
+/* a create refused since the place already exists: 409, or the duplicate key error of the database */
+static bool place_conflict(long status, const char* body, size_t len)
+{
+    return status == 409 || (status == 400 && body != NULL && memmem(body, len, "duplicate", 9) != NULL);
+}
+
+static void on_place_done(void* ctx, int res, long status, const char* body, size_t len)
+{
+    pnode_s* place = (pnode_s*)ctx;
+    place_stage_e stage = place->stage;
+
+    place->stage = PLACE_IDLE;
+    place->retry = 0;
+
+    if (res == CURLE_OK && stage == PLACE_UPDATING && status == 404) {
+        place->exists = 0;
+        /* the slot of the update was just released, the create always fits in the window;
+         * not right after a conflict, a server saying both goes through the retry delay */
+        if (place->wanted && !place->conflict &&
+                mapwize_create_place_async(&mapwize_client, loccfg.apikey, place->doc, on_place_done, place) == 0) {
+            place->sending = place->desired;
+            place->stage = PLACE_CREATING;
+            return;
+        }
+        place->conflict = 0;
+        if (place->wanted)
+            place->retry = place_now() + DEFAULT_LOOP_MS;
+    } else if (res == CURLE_OK && stage == PLACE_CREATING && place_conflict(status, body, len)) {
+        /* the place is there but the listing missed it: replaced by an update, in the slot just released */
+        place->exists = 1;
+        place->conflict = 1;
+        if (place->wanted && mapwize_update_place_async(&mapwize_client, loccfg.apikey, place->place_id, place->doc, on_place_done, place) == 0) {
+            place->sending = place->desired;
+            place->stage = PLACE_UPDATING;
+            return;
+        }
+        place->acked.floor = INT32_MIN;     // unknown, the next pass updates it
+    } else if (res == CURLE_OK && stage == PLACE_DELETING && (status < 300 || status == 404)) {
+        place->exists = 0;
+        __atomic_add_fetch(&deleted, 1, __ATOMIC_RELAXED);
+    } else if (res == CURLE_OK && status < 300) {
+        place->exists = 1;
+        place->conflict = 0;
+        place->acked = place->sending;
+        __atomic_add_fetch(stage == PLACE_CREATING ? &created : &updated, 1, __ATOMIC_RELAXED);
+    } else {
+        if (res == CURLE_OK)
+            MSG_DEBUG(LOG_WARNING, "WARNING~ %s place %s: HTTP %ld %.*s\n",
+                    stage == PLACE_DELETING ? "delete" : stage == PLACE_CREATING ? "create" : "update",
+                    place->place_id, status, (int)len, body);
+        place->retry = place_now() + DEFAULT_LOOP_MS;
+    }
+
+    if (place_differs(place))   // moved again meanwhile, or failed
+        queue_place(place);
+}
+
+/* one place of the organization, the places of the devices are the acknowledged state */
+static int get_listed_place(void* ctx, char* elem, size_t len)
+{
+    json_scan_s* scan = (json_scan_s*)ctx;
+    json_scan_value_s values[PLACE_FIELD_COUNT];
+    char place_id[25];
+    const char* p;
+    char* end;
+    pnode_s* place;
+    place_state_s state;
+
+    if (json_scan(scan, elem, len, values) < 0)
+        return 0;
+
+    if (json_scan_get_string(&values[PLACE_ID], place_id, sizeof(place_id)) != sizeof(place_id) - 1 ||
+            strncmp(place_id, PLACE_ID_PREFIX, sizeof(PLACE_ID_PREFIX) - 1))
+        return 0;   // not the place of a device
+
+    /* "coordinates":[lon,lat] */
+    p = values[PLACE_COORDINATES].ptr;
+    if (values[PLACE_COORDINATES].type != JSON_SCAN_ARRAY || values[PLACE_FLOOR].type != JSON_SCAN_NUMBER)
+        return 0;
+    state.floor = (int)json_scan_get_number(&values[PLACE_FLOOR]);
+    state.lon = strtod(p + 1, &end);
+    if (end == p + 1)
+        return 0;
+    for (p = end; *p == ' ' || *p == ','; p++);
+    state.lat = strtod(p, &end);
+    if (end == p)
+        return 0;
+
+    place = get_place(place_id);
+    if (place == NULL)
+        return -1;
+    place->exists = 1;
+    place->acked = state;
+    place->seen = place_now();
+
+    return 0;
+}
+
+/* list the places once, mapwize then holds the acknowledged state; without it places are updated first, created on a 404 */
+static int list_places(void)
+{
+    json_scan_s scan;
+    json_stream_s stream;
+    int rc = -1;
+
+    if (json_scan_compile(&scan, place_paths, PLACE_FIELD_COUNT))
+        return -1;
+
+    json_stream_init(&stream, get_listed_place, &scan);
+
+    if (mapwize_get_places(&mapwize_client, loccfg.apikey, loccfg.orgid, &stream) == CURLE_OK)
+        rc = json_stream_end(&stream);
+
+    json_stream_free(&stream);
+
+    if (rc < 0) {
+        MSG_DEBUG(LOG_WARNING, "WARNING~ can't list the places, they are updated first and created if missing\n");
+        return -1;
+    }
+
+    places_listed = 1;
+    MSG_DEBUG(LOG_INFO, "INFO~ %d places listed\n", rc);
+
+    return 0;
+}
+
+/*
+ * refetch the beacon list every beacon_refresh seconds, beacons added in mapwize are seen without a restart;
+ * a list loaded from the snapshot is refetched at once
+ */
+static void thread_refresh_beacons()
+{
+    while (!exit_sig && !quit_sig) {
+        if (!beacons_stale &&
+                lgw_eventfd_wait(refresh_efd, loccfg.beacon_refresh > 0 ? loccfg.beacon_refresh * 1000 : -1) == 0)
+            continue;   // rung to stop
+        beacons_stale = 0;
+        if (loccfg.placetypeid == NULL)
+            load_placetype();
+        load_beacons();
+        lgw_epoch_reclaim(&beacon_epoch);
+    }
+}
+
+/*!
+ * \brief store the reading as the latest pending location of its device
+ *
+ * A reading still pending for the same device is stale and is dropped, so
+ * a backlog costs one publish per active device, not one per message.
+ */
+
+static void update_device(inode_s* inode)
+{
+    dnode_s* dnode = NULL;
+    inode_s* stale = NULL;
+    uint32_t bucket;
+    bool wakeup = false;
+
+    if (inode->deveui == NULL) {
+        free_inode_entry(inode);
+        return;
+    }
+
+    inode->list.next = NULL;
+    bucket = lgw_str_hash(inode->deveui, strlen(inode->deveui)) & (DEVICE_HASH_SIZE - 1);
+
+    LGW_LIST_LOCK(&dirty_list);
+
+    for (dnode = device_table[bucket]; dnode != NULL; dnode = dnode->hnext) {
+        if (!strcmp(dnode->deveui, inode->deveui))
+            break;
+    }
+
+    if (dnode == NULL) {
+        dnode = (dnode_s*)lgw_malloc(sizeof(dnode_s));
+        dnode->deveui = lgw_strdup(inode->deveui);
+        dnode->hnext = device_table[bucket];
+        device_table[bucket] = dnode;
+    }
+
+    if (dnode->pending != NULL) {
+        stale = dnode->pending;
+        __atomic_add_fetch(&coalesced, 1, __ATOMIC_RELAXED);
+    } else {
+        LGW_LIST_INSERT_TAIL(&dirty_list, dnode, list);
+        wakeup = true;
+    }
+    dnode->pending = inode;
+
+    LGW_LIST_UNLOCK(&dirty_list);
+
+    if (stale != NULL)
+        free_inode_entry(stale);
+
+    if (wakeup)
+        lgw_eventfd_post(inode_efd);
+}
+
+/*!
+ * \brief detach the pending location of every dirty device
+ * \param batch set to a chain (linked by list.next) of the pending readings
+ * \retval number of readings in the chain
+ */
+
+static int take_dirty_devices(inode_s** batch)
+{
+    dnode_s* dnode = NULL;
+    inode_s* last = NULL;
+    int count = 0;
+
+    *batch = NULL;
+
+    LGW_LIST_LOCK(&dirty_list);
+    while ((dnode = LGW_LIST_REMOVE_HEAD(&dirty_list, list)) != NULL) {
+        if (last == NULL)
+            *batch = dnode->pending;
+        else
+            last->list.next = dnode->pending;
+        last = dnode->pending;
+        dnode->pending = NULL;
+        count++;
+    }
+    dirty_list.size = 0;
+    LGW_LIST_UNLOCK(&dirty_list);
+
+    return count;
+}
+
+static void free_device_table(void)
+{
+    dnode_s* dnode = NULL;
+    int i;
+
+    for (i = 0; i < DEVICE_HASH_SIZE; i++) {
+        while ((dnode = device_table[i]) != NULL) {
+            device_table[i] = dnode->hnext;
+            if (dnode->pending != NULL)
+                free_inode_entry(dnode->pending);
+            lgw_free(dnode->deveui);
+            lgw_free(dnode);
+        }
+    }
+}
+
+/*!
+ * \brief hash the device identity of a message to choose its parser worker
+ *
+ * TTN publishes uplinks on <appid>/devices/<dev_id>/up, so the dev_id is taken
+ * from the topic; other topics fall back to the hardware_serial of the payload.
+ * \retval FNV-1a hash of the identity, 0 if none is found
+ */
+
+static uint32_t payload_shard_hash(const char* topic, const char* payload, int len)
+{
+    const char* key = NULL;
+    const char* end = NULL;
+
+    if (topic != NULL && (key = strstr(topic, "/devices/")) != NULL) {
+        key += strlen("/devices/");
+        end = strchr(key, '/');
+        if (end == NULL)
+            end = key + strlen(key);
+    } else if (payload != NULL && (key = memmem(payload, len, "\"hardware_serial\"", 17)) != NULL) {
+        key = memchr(key + 17, '"', payload + len - (key + 17));
+        if (key != NULL) {
+            key++;
+            end = memchr(key, '"', payload + len - key);
+        }
+    }
+
+    if (key == NULL || end == NULL)
+        return 0;
+
+    return lgw_str_hash(key, end - key);
+}
+
+/*!
+ * \brief calc distance between node and gw, formula: d = 10^((abs(RSSI) - A) / (10 * n)) 
+ * \param rate the rssi of the distance of 1 meter, default (45-49)?
+ * \param div attenuation, default 2.0?
+ * \retval distance
+ */
 
 static float calc_dist_byrssi(int rssi, int rate, float div)
 {
@@ -766,21 +1744,324 @@ static float calc_dist_byrssi(int rssi, int rate, float div)
     return pow(10, power);
 }
 
+static void free_payload_entry(payload_s* payload)
+{
+    MQTTAsync_message* message = (MQTTAsync_message*)payload->msg;
+    MQTTAsync_freeMessage(&message);
+    payload->content = NULL;
+    payload->msg = NULL;
+}
+
+/* decoder of a device, the first model whose pattern matches dev_id, else the default one */
+static const beacon_layout_s* get_device_layout(const char* devid)
+{
+    model_s* model_entry = NULL;
+
+    LGW_LIST_TRAVERSE(&loccfg.model_list, model_entry, list) {
+        if (!fnmatch(model_entry->pattern, devid, 0))
+            return model_entry->layout;
+    }
+
+    return loccfg.layout;
+}
+
+/* decode payload_raw, the strongest beacon goes to the inode fields, the others to reads */
+static int decode_raw_beacons(inode_s* inode, const beacon_layout_s* layout, const json_scan_value_s* raw)
+{
+    char b64[344];      // base64 of the largest LoRaWAN payload
+    uint8_t frame[256];
+    beacon_read_s reads[MAX_FRAME_BEACONS];
+    const char* str = raw->ptr;
+    int len = raw->len;
+    int count;
+
+    if (raw->type != JSON_SCAN_STRING) {
+        MSG_DEBUG(LOG_WARNING, "WARNING~ can't get payload_raw, drop the payload\n");
+        return -1;
+    }
+
+    if (raw->escaped) {     // "\/" is valid JSON for '/'
+        if ((len = json_scan_get_string(raw, b64, sizeof(b64))) < 0) {
+            MSG_DEBUG(LOG_WARNING, "WARNING~ payload_raw too long, drop the payload\n");
+            return -1;
+        }
+        str = b64;
+    }
+
+    len = b64_to_bin(str, len, frame, sizeof(frame));
+    if (len < 0) {
+        MSG_DEBUG(LOG_WARNING, "WARNING~ payload_raw is not valid base64, drop the payload\n");
+        return -1;
+    }
+
+    count = beacon_decode_frame(layout, frame, len, reads, MAX_FRAME_BEACONS);
+    if (count <= 0) {
+        MSG_DEBUG(LOG_WARNING, "WARNING~ no %s beacon in the %d bytes frame of %s, drop the payload\n",
+                layout->name, len, inode->devid);
+        return -1;
+    }
+
+    inode->uuid = lgw_strdup(reads[0].uuid);
+    inode->major = reads[0].major;
+    inode->minor = reads[0].minor;
+    inode->rssi = reads[0].rssi;
+    inode->dist = calc_dist_byrssi(inode->rssi, loccfg.rssirate, loccfg.rssidiv);
+
+    if (count > 1) {
+        /* the strongest beacon alone still gives a position */
+        inode->reads = (beacon_read_s*)lgw_malloc((count - 1) * sizeof(beacon_read_s));
+        if (inode->reads != NULL) {
+            memcpy(inode->reads, &reads[1], (count - 1) * sizeof(beacon_read_s));
+            inode->nreads = count - 1;
+        } else {
+            MSG_DEBUG(LOG_WARNING, "WARNING~ no memory for the other %d beacons of %s, keep the strongest\n", count - 1, inode->devid);
+        }
+    }
+
+    MSG_DEBUG(LOG_INFO, "INFO~ decoded %d beacons from %s, strongest rssi %d\n", count, inode->devid, inode->rssi);
+
+    return 0;
+}
+
+/* row of the registered beacon of a reading, -1 if unknown, the uuid is compared on its tail */
+static int find_beacon(const beacon_reg_s* reg, const char* uuid, int major, int minor)
+{
+    beacon_key_s key;
+
+    if (reg == NULL || beacon_key_make(&key, uuid, major, minor))
+        return -1;
+
+    return beacon_reg_find(reg, &key);
+}
+
+static void free_beacon_reg(void* reg)
+{
+    if (reg == NULL)
+        return;
+    beacon_reg_free((beacon_reg_s*)reg);
+    lgw_free(reg);
+}
+
+/* fetch the placetypes of the organization, sets loccfg.placetypeid */
+static int load_placetype(void)
+{
+    curlstr_s* curl_write_data;
+    int rc = -1;
+
+    curl_write_data = init_curl_write_data();
+
+    if (mapwize_get_placetype(&mapwize_client, loccfg.apikey, loccfg.orgid, (void*)curl_write_data) == CURLE_OK)
+        rc = get_placetype(curl_write_data);
+
+    lgw_free(curl_write_data->ptr);
+    lgw_free(curl_write_data);
+
+    return rc;
+}
+
+/* map the beacon list saved by the last run, used only if it was built with the same configure */
+static int load_snapshot(void)
+{
+    const char* tags[SNAP_TAG_COUNT];
+    beacon_reg_s* reg;
+
+    if (loccfg.snapshot == NULL || loccfg.snapshot[0] == '\0')
+        return -1;
+
+    reg = (beacon_reg_s*)lgw_malloc(sizeof(beacon_reg_s));
+    if (reg == NULL)
+        return -1;
+
+    if (beacon_reg_load(reg, loccfg.snapshot, tags, SNAP_TAG_COUNT, &snapshot_sum)) {
+        MSG_DEBUG(LOG_INFO, "INFO~ no usable beacon snapshot %s\n", loccfg.snapshot);
+        lgw_free(reg);
+        return -1;
+    }
+
+    if (strcmp(tags[SNAP_ORGID], loccfg.orgid ? loccfg.orgid : "") ||
+            strcmp(tags[SNAP_UNIVERSES], loccfg.universesid ? loccfg.universesid : "") ||
+            strcmp(tags[SNAP_PLACETYPE], loccfg.placetype ? loccfg.placetype : "") ||
+            tags[SNAP_PLACETYPEID][0] == '\0' ||
+            (loccfg.placetypeid != NULL && strcmp(tags[SNAP_PLACETYPEID], loccfg.placetypeid))) {
+        MSG_DEBUG(LOG_INFO, "INFO~ beacon snapshot %s was built with another configure, ignored\n", loccfg.snapshot);
+        free_beacon_reg(reg);
+        snapshot_sum = 0;
+        return -1;
+    }
+
+    if (loccfg.placetypeid == NULL)
+        loccfg.placetypeid = lgw_strdup(tags[SNAP_PLACETYPEID]);
+
+    beacon_snap = reg;
+
+    MSG_DEBUG(LOG_INFO, "INFO~ %d beacons loaded from snapshot %s, %zu bytes\n",
+            reg->count, loccfg.snapshot, beacon_reg_memory(reg));
+
+    return 0;
+}
+
+/* fetch the beacon list and publish it as the new registry, the readers keep the old one until they leave */
+static int load_beacons(void)
+{
+    json_stream_s stream;
+    beacon_reg_s* reg;
+    beacon_reg_s* old = beacon_snap;    // only this thread stores beacon_snap
+    int rc = -1;
+
+    reg = (beacon_reg_s*)lgw_malloc(sizeof(beacon_reg_s));
+    if (reg == NULL)
+        return -1;
+    beacon_reg_init(reg);
+
+    /* the beacons are registered while the list is received, only one of them is buffered */
+    json_stream_init(&stream, get_beacon, reg);
+
+    if (mapwize_get_beacons(&mapwize_client, loccfg.apikey, &stream) == CURLE_OK)
+        rc = json_stream_end(&stream);
+
+    json_stream_free(&stream);
+
+    /* a failed or empty answer doesn't wipe the beacons we have */
+    if (rc < 0 || (reg->count == 0 && old != NULL && old->count > 0)) {
+        MSG_DEBUG(LOG_WARNING, "WARNING~ can't get the beacon list, keep the %d current beacons\n", old ? old->count : 0);
+        free_beacon_reg(reg);
+        return -1;
+    }
+
+    __atomic_store_n(&beacon_snap, reg, __ATOMIC_SEQ_CST);
+    lgw_epoch_retire(&beacon_epoch, old, free_beacon_reg);
+
+    MSG_DEBUG(LOG_INFO, "INFO~ %d beacons registered, %d distinct ids, %zu bytes\n",
+            reg->count, reg->str_count, beacon_reg_memory(reg));
+
+    if (loccfg.snapshot != NULL && loccfg.snapshot[0] != '\0') {
+        const char* tags[SNAP_TAG_COUNT] = { loccfg.orgid, loccfg.universesid, loccfg.placetype, loccfg.placetypeid };
+
+        if (beacon_reg_save(reg, loccfg.snapshot, tags, SNAP_TAG_COUNT, &snapshot_sum) < 0)
+            MSG_DEBUG(LOG_WARNING, "WARNING~ can't save the beacon snapshot %s\n", loccfg.snapshot);
+    }
+
+    return 0;
+}
+
+/* serialize once the part of the place document which only depends on the beacon, retval its length */
+static int build_place_tail(char** tail, const beacon_info_s* info)
+{
+    char lon[40], lat[40];
+
+    lgw_dtoa_fixed(info->lon, PLACE_COORD_PREC, lon);
+    lgw_dtoa_fixed(info->lat, PLACE_COORD_PREC, lat);
+
+    *tail = NULL;
+    return lgw_asprintf(tail,
+            "\"floor\":%d,\"geometry\":{\"type\":\"Point\",\"coordinates\":[%s,%s]},\"universes\":\"%s\",\"placeTypeId\":\"%s\",\"isPublished\":true,\"isSearchable\":true,\"isVisible\":true,\"isClickable\":true,\"venueId\":\"%s\",\"owner\":\"%s\"}",
+            info->floor, lon, lat,
+            loccfg.universesid, loccfg.placetypeid,
+            info->venueid, info->orgid);
+}
+
+#define PUT_STR(str, len) do { memcpy(p, (str), (len)); p += (len); } while (0)
+#define PUT_LIT(lit) PUT_STR(lit, sizeof(lit) - 1)
+
+/* place document of a device at a beacon: the device fields, then the precompiled tail of the beacon */
+static int write_place(char* buf, size_t size, const inode_s* inode, const char* place_id, const char* tail, size_t tail_len)
+{
+    static const char name[] = "{\"name\":\"";
+    static const char description[] = "\",\"description\":\"moveable place point (";
+    static const char id[] = ")\",\"_id\":\"";
+    static const char keywords[] = "\",\"searchKeywords\":\"";
+    static const char title[] = "\",\"translations\":[{\"title\":\"";
+    static const char language[] = "\",\"language\":\"en\"}],";
+
+    size_t devid_len = strlen(inode->devid);
+    size_t deveui_len = strlen(inode->deveui);
+    size_t place_id_len = strlen(place_id);
+    size_t len;
+    char* p = buf;
+
+    len = sizeof(name) + sizeof(description) + sizeof(id) + sizeof(keywords) + sizeof(title) + sizeof(language) - 6
+        + 3 * devid_len + deveui_len + place_id_len + tail_len;
+    if (len + 1 > size)
+        return -1;
+
+    PUT_LIT(name);
+    PUT_STR(inode->devid, devid_len);
+    PUT_LIT(description);
+    PUT_STR(inode->deveui, deveui_len);
+    PUT_LIT(id);
+    PUT_STR(place_id, place_id_len);
+    PUT_LIT(keywords);
+    PUT_STR(inode->devid, devid_len);
+    PUT_LIT(title);
+    PUT_STR(inode->devid, devid_len);
+    PUT_LIT(language);
+    PUT_STR(tail, tail_len);
+    *p = '\0';
+
+    return (int)len;
+}
+
+#undef PUT_LIT
+#undef PUT_STR
+
+/* copy a scanned string, NULL if the field is missing or not a string */
+static char* scan_strdup(const json_scan_value_s* value)
+{
+    char* str;
+
+    if (value->type != JSON_SCAN_STRING)
+        return NULL;
+
+    if (!value->escaped)
+        return lgw_strndup(value->ptr, value->len);
+
+    /* decoding never makes a string longer */
+    str = (char*)lgw_malloc(value->len + 5);
+    if (str != NULL && json_scan_get_string(value, str, value->len + 5) < 0) {
+        lgw_free(str);
+        str = NULL;
+    }
+    return str;
+}
+
 static void free_inode_entry(inode_s* node)
 {
+    lgw_free(node->reads);
     lgw_free(node->devid);
     lgw_free(node->deveui);
     lgw_free(node->uuid);
     lgw_free(node);
 }
 
+static serv_type_e get_serv_type(const char* str)
+{
+    if (!strcasecmp(str, "ttn"))
+        return TTN;
+    return UNK;
+}
+
 static void free_cfg_entry(loccfg_s* cfg)
 {
+    topic_s* topic_entry = NULL;
+    model_s* model_entry = NULL;
+
+    while ((model_entry = LGW_LIST_REMOVE_HEAD(&cfg->model_list, list)) != NULL) {
+        lgw_free(model_entry->pattern);
+        lgw_free(model_entry);
+    }
+
+    while ((topic_entry = LGW_LIST_REMOVE_HEAD(&cfg->topic_list, list)) != NULL) {
+        lgw_free(topic_entry->topic_id);
+        lgw_free(topic_entry->topic);
+        lgw_free(topic_entry);
+    }
+
     lgw_free(cfg->servaddr);
     lgw_free(cfg->clientid);
     lgw_free(cfg->username);
     lgw_free(cfg->password);
     lgw_free(cfg->topic);
+    lgw_free(cfg->shared_group);
     lgw_free(cfg->connection);
     lgw_free(cfg->apikey);
     lgw_free(cfg->venueid);
@@ -788,6 +2069,7 @@ static void free_cfg_entry(loccfg_s* cfg)
     lgw_free(cfg->universesid);
     lgw_free(cfg->placetype);
     lgw_free(cfg->placetypeid);
+    lgw_free(cfg->snapshot);
 }
 
 static int get_placetype(curlstr_s* cstr)
@@ -802,16 +2084,16 @@ static int get_placetype(curlstr_s* cstr)
 
     MSG_DEBUG(LOG_INFO, "DEBUG~ %s\n", cstr->ptr);
 
-    root_val = json_parse_string_with_comments(cstr->ptr);
+    root_val = json_parse_string_insitu(cstr->ptr, mapwize_arena);
     if (root_val == NULL) {
-        MSG_DEBUG(LOG_ERROR, "ERROR~ \n %s \n is not a valid JSON string\n", cstr->ptr);
-        free(cstr->ptr);
+        MSG_DEBUG(LOG_ERROR, "ERROR~ the response above is not a valid JSON string\n");  // parsed in place, cstr->ptr is mangled
+        json_arena_reset(mapwize_arena);
         return -1;
     }
 
     root_array = json_value_get_array(root_val);
     if (NULL == root_array) {
-        json_value_free(root_val);
+        json_arena_reset(mapwize_arena);
         return -1;
     }
 
@@ -838,160 +2120,163 @@ static int get_placetype(curlstr_s* cstr)
         MSG_DEBUG(LOG_INFO, "DEBUG~ placetypeid is NULL, Must configure a currect placetypeid\n" );
     }
 
-    json_value_free(root_val);
+    json_arena_reset(mapwize_arena);
 
     return 0;
 }
 
-static int get_beacons(curlstr_s* cstr)
+/* one element of the beacon list, parsed and registered as soon as it is received */
+static int get_beacon(void* ctx, char* elem, size_t len)
 {
-    int i, count;
+    beacon_reg_s* reg = (beacon_reg_s*)ctx;
+    int rc, major, minor;
 
     JSON_Value *root_val;
     JSON_Object *iobj = NULL;
     JSON_Object *obj = NULL;
-    JSON_Array *root_array = NULL;
     JSON_Value *val = NULL; /* needed to detect the absence of some fields */
     const char *str;
     
     bool getbeacon = false;
 
-    ibeacon_s* ibeacon_entry = NULL;
+    beacon_info_s info;
+    beacon_key_s key;
+    const char* uuid;
+    char* place_tail;
 
-    MSG_DEBUG(LOG_INFO, "DEBUG~ %s\n", cstr->ptr);
+    (void)len;  // elem is null terminated by the stream, parsed in place
 
-    root_val = json_parse_string_with_comments(cstr->ptr);
-    if (root_val == NULL) {
-        MSG_DEBUG(LOG_ERROR, "ERROR~ \n %s \n is not a valid JSON string\n", cstr->ptr);
-        free(cstr->ptr);
-        return -1;
+    root_val = json_parse_string_insitu(elem, mapwize_arena);
+    iobj = json_value_get_object(root_val);
+    if (iobj == NULL) {
+        MSG_DEBUG(LOG_WARNING, "WARNING~ a beacon of the list is not a JSON object, skip!\n");
+        json_arena_reset(mapwize_arena);
+        return 0;
     }
 
-    root_array = json_value_get_array(root_val);
-    if (NULL == root_array) {
-        json_value_free(root_val);
-        free(cstr->ptr);
-        return -1;
+    str = json_object_get_string(iobj, "type");
+    if (str != NULL && !strcmp("ibeacon", str)) {
+        getbeacon = true;
+    } else {
+        MSG_DEBUG(LOG_INFO, "DEBUG~ current beacon type is %s\n", str);
+        goto out;  // type is not ibeacon, skip ...
     }
 
-    count = json_array_get_count(root_array);
-    
-    for (i = 0; i < count; i++) {
+    memset(&info, 0, sizeof(info));     // the strings point into the response until the arena reset
+    uuid = NULL;
+    major = minor = 0;
 
-        iobj = json_array_get_object(root_array, i);
+    //get venueId
+    str = json_object_get_string(iobj, "_id");
+    if (str != NULL) {
+        info.id = str;
+        MSG_DEBUG(LOG_INFO, "DEBUG~ Id set to %s\n", str);
+    } else {
+        getbeacon = false;
+    }
 
-        str = json_object_get_string(iobj, "type");
-        if (str != NULL && !strcmp("ibeacon", str)) {
-            getbeacon = true;
-        } else {
-            MSG_DEBUG(LOG_INFO, "DEBUG~ current beacon type is %s\n", str);
-            continue;  // type is not ibeacon, skip ...
-        }
+    //get venueId
+    str = json_object_get_string(iobj, "venueId");
+    if (str != NULL) {
+        info.venueid = str;
+        MSG_DEBUG(LOG_INFO, "DEBUG~ venueId set to %s\n", str);
+    } else {
+        getbeacon = false;
+    }
 
-        ibeacon_entry = (ibeacon_s*)lgw_malloc(sizeof(ibeacon_s));
+    // get owner, orgid
+    str = json_object_get_string(iobj, "owner");
+    if (str != NULL && getbeacon) {
+        info.orgid = str;
+        MSG_DEBUG(LOG_INFO, "DEBUG~ orgId set to %s\n", str);
+    } else {
+        getbeacon = false;
+    }
 
-        //get venueId
-        str = json_object_get_string(iobj, "_id");
-        if (str != NULL) {
-            ibeacon_entry->id = lgw_strdup(str);
-            MSG_DEBUG(LOG_INFO, "DEBUG~ Id set to %s\n", str);
-        } else {
-            getbeacon = false;
-        }
+    // get floor
+    val = json_object_get_value(iobj, "floor");
+    if (getbeacon && (json_value_get_type(val) == JSONNumber)) {
+        info.floor = (int)json_value_get_number(val);
+        MSG_DEBUG(LOG_INFO, "DEBUG~ floor set to %d\n", info.floor);
+    } else {
+        getbeacon = false;
+    }
 
-        //get venueId
-        str = json_object_get_string(iobj, "venueId");
-        if (str != NULL) {
-            ibeacon_entry->venueid = lgw_strdup(str);
-            MSG_DEBUG(LOG_INFO, "DEBUG~ venueId set to %s\n", str);
+    // get owner, orgid
+    obj = json_object_get_object(iobj, "properties");
+    if (obj != NULL && getbeacon) {
+        str = json_object_get_string(obj, "uuid");
+        if (str != NULL && strlen(str) >= BEACON_UUID_TAIL) {
+            uuid = str + strlen(str) - BEACON_UUID_TAIL;
+            MSG_DEBUG(LOG_INFO, "DEBUG~ uuid set to %s\n", uuid);  // the last 12 characters
         } else {
             getbeacon = false;
         }
-
-        // get owner, orgid
-        str = json_object_get_string(iobj, "owner");
+        str = json_object_get_string(obj, "major");
         if (str != NULL && getbeacon) {
-            ibeacon_entry->orgid = lgw_strdup(str);
-            MSG_DEBUG(LOG_INFO, "DEBUG~ orgId set to %s\n", str);
+            major = atoi(str);
+            MSG_DEBUG(LOG_INFO, "DEBUG~ major set to %d\n", major);
         } else {
             getbeacon = false;
         }
-
-        // get floor
-        val = json_object_get_value(iobj, "floor");
-        if (getbeacon && (json_value_get_type(val) == JSONNumber)) {
-            ibeacon_entry->floor = (int)json_value_get_number(val);
-            MSG_DEBUG(LOG_INFO, "DEBUG~ floor set to %d\n", ibeacon_entry->floor);
+        str = json_object_get_string(obj, "minor");
+        if (str != NULL && getbeacon) {
+            minor = atoi(str);
+            MSG_DEBUG(LOG_INFO, "DEBUG~ minor set to %d\n", minor);
         } else {
             getbeacon = false;
         }
+    } else {
+        getbeacon = false;
+    }
 
-        // get owner, orgid
-        obj = json_object_get_object(iobj, "properties");
-        if (obj != NULL && getbeacon) {
-            str = json_object_get_string(obj, "uuid");
-            if (str != NULL) {
-                ibeacon_entry->uuid = lgw_strdup(str + 24);
-                MSG_DEBUG(LOG_INFO, "DEBUG~ uuid set to %s\n", ibeacon_entry->uuid);  // the last 12 characters
-            } else {
-                getbeacon = false;
-            }
-            str = json_object_get_string(obj, "major");
-            if (str != NULL && getbeacon) {
-                ibeacon_entry->major = atoi(str);
-                MSG_DEBUG(LOG_INFO, "DEBUG~ major set to %d\n", ibeacon_entry->major);
-            } else {
-                getbeacon = false;
-            }
-            str = json_object_get_string(obj, "minor");
-            if (str != NULL && getbeacon) {
-                ibeacon_entry->minor = atoi(str);
-                MSG_DEBUG(LOG_INFO, "DEBUG~ minor set to %d\n", ibeacon_entry->minor);
-            } else {
-                getbeacon = false;
-            }
+    obj = json_object_get_object(iobj, "location");
+    if (obj != NULL && getbeacon) {
+        val = json_object_get_value(obj, "lat");
+        if (getbeacon && (json_value_get_type(val) == JSONNumber)) {
+            info.lat = (double)json_value_get_number(val);
+            MSG_DEBUG(LOG_INFO, "DEBUG~ lat set to %f\n", info.lat);
         } else {
             getbeacon = false;
         }
 
-        obj = json_object_get_object(iobj, "location");
-        if (obj != NULL && getbeacon) {
-            val = json_object_get_value(obj, "lat");
-            if (getbeacon && (json_value_get_type(val) == JSONNumber)) {
-                ibeacon_entry->gps.lat = (double)json_value_get_number(val);
-                MSG_DEBUG(LOG_INFO, "DEBUG~ lat set to %f\n", ibeacon_entry->gps.lat);
-            } else {
-                getbeacon = false;
-            }
-
-            val = json_object_get_value(obj, "lon");
-            if (getbeacon && (json_value_get_type(val) == JSONNumber)) {
-                ibeacon_entry->gps.lon = (double)json_value_get_number(val);
-                MSG_DEBUG(LOG_INFO, "DEBUG~ lon set to %f\n", ibeacon_entry->gps.lon);
-            } else {
-                getbeacon = false;
-            }
+        val = json_object_get_value(obj, "lon");
+        if (getbeacon && (json_value_get_type(val) == JSONNumber)) {
+            info.lon = (double)json_value_get_number(val);
+            MSG_DEBUG(LOG_INFO, "DEBUG~ lon set to %f\n", info.lon);
         } else {
             getbeacon = false;
         }
+    } else {
+        getbeacon = false;
+    }
 
-        if (!getbeacon) {
-            MSG_DEBUG(LOG_INFO, "DEBUG~ Getbeacon error skip!\n");
-            lgw_free(ibeacon_entry->id);
-            lgw_free(ibeacon_entry->venueid);
-            lgw_free(ibeacon_entry->orgid);
-            lgw_free(ibeacon_entry->uuid);
-            lgw_free(ibeacon_entry);
-            continue;
-        }
+    if (getbeacon && beacon_key_make(&key, uuid, major, minor)) {
+        MSG_DEBUG(LOG_WARNING, "WARNING~ beacon %s has an invalid uuid, major or minor\n", info.id);
+        getbeacon = false;
+    }
 
-        // getbaecon true 
-        LGW_LIST_INSERT_TAIL(&ibeacon_list, ibeacon_entry, list);
+    if (!getbeacon) {
+        MSG_DEBUG(LOG_INFO, "DEBUG~ Getbeacon error skip!\n");
+        goto out;
+    }
 
+    info.place_tail_len = build_place_tail(&place_tail, &info);
+    if (info.place_tail_len < 0) {
+        MSG_DEBUG(LOG_WARNING, "WARNING~ can't build the place template of beacon %s, skip!\n", info.id);
+        goto out;
     }
+    info.place_tail = place_tail;
 
-    json_value_free(root_val);
+    rc = beacon_reg_add(reg, &key, &info, NULL);
+    lgw_free(place_tail);
+    if (rc > 0)
+        MSG_DEBUG(LOG_WARNING, "WARNING~ beacon %s has the uuid, major and minor of another beacon, skip!\n", info.id);
+    else if (rc < 0)
+        MSG_DEBUG(LOG_WARNING, "WARNING~ can't register beacon %s, skip!\n", info.id);
 
-    return 0;
+out:
+    json_arena_reset(mapwize_arena);     // the arena holds one beacon at a time
 
+    return 0;
 }
@@ -27,28 +27,47 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <curl/curl.h>
 
 #include "utilities.h"
 #include "mapwize_api.h"
 
+#define CURLSTR_MIN_SIZE    1024
+
 static size_t curl_write_cb(char* ptr, size_t size, size_t nmemb, void* s)
 {
     curlstr_s* cstr = (curlstr_s*)s;
 
     size_t new_len = cstr->len + size*nmemb;
+    size_t new_size;
+    char* new_ptr;
 
-    cstr->ptr = lgw_realloc(cstr->ptr, new_len+1);
-    if (cstr->ptr == NULL) {
-        fprintf(stderr, "crul callback function realloc() failed\n");
-        return cstr->len;
+    if (new_len + 1 > cstr->size) {     // grow by doubling, not by chunk
+        new_size = cstr->size ? cstr->size : CURLSTR_MIN_SIZE;
+        while (new_size < new_len + 1)
+            new_size *= 2;
+        new_ptr = lgw_realloc(cstr->ptr, new_size);
+        if (new_ptr == NULL) {
+            fprintf(stderr, "crul callback function realloc() failed\n");
+            return 0;   // abort the transfer, cstr keeps what it got
+        }
+        cstr->ptr = new_ptr;
+        cstr->size = new_size;
     }
 
     memcpy(cstr->ptr + cstr->len, ptr, size*nmemb);
     cstr->ptr[new_len] = '\0';
     cstr->len = new_len;
 
-    MSG_DEBUG(LOG_INFO, "DEBUG~ %s\n", cstr->ptr);
+    return size*nmemb;
+}
+
+/* feed a chunk to the array splitter, the elements are handled as they complete */
+static size_t curl_stream_cb(char* ptr, size_t size, size_t nmemb, void* s)
+{
+    if (json_stream_feed((json_stream_s*)s, ptr, size*nmemb))
+        return 0;   // not an array, or the consumer gave up: abort the transfer
 
     return size*nmemb;
 }
@@ -61,7 +80,8 @@ curlstr_s* init_curl_write_data()
       exit(EXIT_FAILURE);
     }
     s->len = 0;
-    s->ptr = lgw_malloc(s->len+1);
+    s->size = CURLSTR_MIN_SIZE;
+    s->ptr = lgw_malloc(s->size);
     if (s->ptr == NULL) {
       fprintf(stderr, "malloc() failed\n");
       exit(EXIT_FAILURE);
@@ -70,158 +90,384 @@ curlstr_s* init_curl_write_data()
     return s;
 }
 
-int mapwize_signin(char* apikey, char* email, char* passwd) 
+static void share_lock_cb(CURL* handle, curl_lock_data data, curl_lock_access access, void* userptr)
 {
-    char url[96] = {0};
-    char data[96] = {0};
+    mapwize_client_s* client = (mapwize_client_s*)userptr;
 
-    CURL *curl;
-    CURLcode res;
-    curl = curl_easy_init();
+    (void)handle;
+    (void)access;     // shared and single use alike, one mutex per kind of data
 
-    snprintf(url, sizeof(url), "https://api.mapwize.io/v1/auth/signin?api_key=%s", apikey);
-    snprintf(data, sizeof(data), "{\"email\":\"%s\", \"password\":\"%s\"}", email, passwd);
+    pthread_mutex_lock(&client->share_lock[data]);
+}
+
+static void share_unlock_cb(CURL* handle, curl_lock_data data, void* userptr)
+{
+    mapwize_client_s* client = (mapwize_client_s*)userptr;
+
+    (void)handle;
+
+    pthread_mutex_unlock(&client->share_lock[data]);
+}
+
+int mapwize_client_init(mapwize_client_s* client, int window)
+{
+    int i;
 
-    if(curl) {
-        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "POST");
-        curl_easy_setopt(curl, CURLOPT_URL, url);
-        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-        curl_easy_setopt(curl, CURLOPT_DEFAULT_PROTOCOL, "https");
-        struct curl_slist *headers = NULL;
-        headers = curl_slist_append(headers, "Content-Type: application/json");
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data);
-        res = curl_easy_perform(curl);
+    memset(client, 0, sizeof(mapwize_client_s));
+
+    if (window < 1)
+        window = 1;
+    else if (window > MAPWIZE_MAX_WINDOW)
+        window = MAPWIZE_MAX_WINDOW;
+    client->window = window;
+
+    client->share = curl_share_init();
+    if (client->share == NULL)
+        return -1;
+
+    for (i = 0; i < CURL_LOCK_DATA_LAST; i++)
+        pthread_mutex_init(&client->share_lock[i], NULL);
+    pthread_mutex_init(&client->pool_lock, NULL);
+
+    curl_share_setopt(client->share, CURLSHOPT_LOCKFUNC, share_lock_cb);
+    curl_share_setopt(client->share, CURLSHOPT_UNLOCKFUNC, share_unlock_cb);
+    curl_share_setopt(client->share, CURLSHOPT_USERDATA, client);
+    curl_share_setopt(client->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(client->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    /* the connections are not shared: libcurl doesn't support a connection cache used by concurrent threads,
+     * a pooled handle keeps its own and the multi handle has one for the asynchronous requests */
+
+    client->json_headers = curl_slist_append(NULL, "Content-Type: application/json");
+    client->multi = curl_multi_init();
+    if (client->json_headers == NULL || client->multi == NULL) {
+        mapwize_client_destroy(client);
+        return -1;
     }
-    curl_easy_cleanup(curl);
-    return (int)res;
+
+    curl_multi_setopt(client->multi, CURLMOPT_PIPELINING, (long)CURLPIPE_MULTIPLEX);
+    curl_multi_setopt(client->multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)window);
+
+    return 0;
+}
+
+void mapwize_client_destroy(mapwize_client_s* client)
+{
+    int i;
+
+    mapwize_req_s* req;
+
+    if (client->share == NULL)
+        return;
+
+    while ((req = client->reqs) != NULL) {
+        client->reqs = req->next;
+        curl_multi_remove_handle(client->multi, req->curl);
+        curl_easy_cleanup(req->curl);
+        lgw_free(req->resp.ptr);
+        lgw_free(req);
+    }
+    client->inflight = 0;
+    if (client->multi != NULL)
+        curl_multi_cleanup(client->multi);
+    client->multi = NULL;
+
+    while (client->idle > 0)
+        curl_easy_cleanup(client->pool[--client->idle]);
+
+    curl_share_cleanup(client->share);
+    client->share = NULL;
+    curl_slist_free_all(client->json_headers);
+    client->json_headers = NULL;
+
+    for (i = 0; i < CURL_LOCK_DATA_LAST; i++)
+        pthread_mutex_destroy(&client->share_lock[i]);
+    pthread_mutex_destroy(&client->pool_lock);
 }
 
+/* take an idle handle of the pool, or a new one */
+static CURL* client_acquire(mapwize_client_s* client)
+{
+    CURL* curl = NULL;
+
+    pthread_mutex_lock(&client->pool_lock);
+    if (client->idle > 0)
+        curl = client->pool[--client->idle];
+    pthread_mutex_unlock(&client->pool_lock);
+
+    if (curl == NULL) {
+        curl = curl_easy_init();
+        if (curl == NULL)
+            return NULL;
+    }
+
+    curl_easy_setopt(curl, CURLOPT_SHARE, client->share);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_DEFAULT_PROTOCOL, "https");
 
-int mapwize_get_placetype(char* apikey, char* orgid, void* data)
+    return curl;
+}
+
+/* give a handle back, its connection stays open for the next request */
+static void client_release(mapwize_client_s* client, CURL* curl)
 {
-    CURL *curl;
+    curl_easy_reset(curl);      // options only, the caches and connections are kept
+
+    pthread_mutex_lock(&client->pool_lock);
+    if (client->idle < MAPWIZE_POOL_SIZE) {
+        client->pool[client->idle++] = curl;
+        curl = NULL;
+    }
+    pthread_mutex_unlock(&client->pool_lock);
+
+    if (curl != NULL)
+        curl_easy_cleanup(curl);
+}
+
+/* one request on a pooled handle, body is sent as JSON, the response goes to write_cb if set */
+static int client_perform(mapwize_client_s* client, const char* method, const char* url, const char* body,
+        curl_write_callback write_cb, void* data, const char* what)
+{
+    char errbuf[CURL_ERROR_SIZE];
+    long status = 0;
     CURLcode res;
+    CURL* curl;
 
-    char url[128] = {0};
-    snprintf(url, sizeof(url), "https://api.mapwize.io/v1/placeTypes?api_key=%s&organizationId=%s", apikey, orgid);
+    curl = client_acquire(client);
+    if (curl == NULL)
+        return CURLE_FAILED_INIT;
 
-    curl = curl_easy_init();
-    if(curl) {
-        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "GET");
-        curl_easy_setopt(curl, CURLOPT_URL, url);
-        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-        curl_easy_setopt(curl, CURLOPT_DEFAULT_PROTOCOL, "https");
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curl_write_cb);
+    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, method);
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, errbuf);
+    if (body != NULL) {
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, client->json_headers);
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body);
+    }
+    if (write_cb != NULL) {
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_cb);
         curl_easy_setopt(curl, CURLOPT_WRITEDATA, data);
-        struct curl_slist *headers = NULL;
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-        res = curl_easy_perform(curl);
     }
-    curl_easy_cleanup(curl);
+
+    errbuf[0] = '\0';
+    res = curl_easy_perform(curl);
+    if (res != CURLE_OK) {
+        MSG_DEBUG(LOG_WARNING, "WARNING~, %s error: %s\n", what, strlen(errbuf) > 1 ? errbuf : curl_easy_strerror(res));
+    } else {
+        /* an error page is no answer, whatever the body looks like */
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+        if (status < 200 || status >= 300) {
+            MSG_DEBUG(LOG_WARNING, "WARNING~, %s error: HTTP %ld\n", what, status);
+            res = CURLE_HTTP_RETURNED_ERROR;
+        }
+    }
+
+    client_release(client, curl);
+
     return (int)res;
 }
 
-int mapwize_create_place(char* apikey, char* data)
+/* start a request on a pooled handle, its completion is called back from mapwize_client_run */
+static int client_submit(mapwize_client_s* client, const char* method, const char* url, const char* body,
+        mapwize_done_cb done, void* ctx, const char* what)
+{
+    mapwize_req_s* req;
+    CURL* curl;
+
+    if (client->inflight >= client->window)
+        return 1;
+
+    req = (mapwize_req_s*)lgw_malloc(sizeof(mapwize_req_s));
+    if (req == NULL)
+        return -1;
+
+    curl = client_acquire(client);
+    if (curl == NULL) {
+        lgw_free(req);
+        return -1;
+    }
+
+    req->curl = curl;
+    req->done = done;
+    req->ctx = ctx;
+    req->what = what;
+
+    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, method);
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, req->errbuf);
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+    curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);      // wait to multiplex on a connection being set up
+    if (body != NULL) {
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, client->json_headers);
+        curl_easy_setopt(curl, CURLOPT_COPYPOSTFIELDS, body);
+    }
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curl_write_cb);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &req->resp);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, req);
+
+    if (curl_multi_add_handle(client->multi, curl) != CURLM_OK) {
+        client_release(client, curl);
+        lgw_free(req);
+        return -1;
+    }
+
+    req->next = client->reqs;
+    client->reqs = req;
+    client->inflight++;
+
+    return 0;
+}
+
+/* call back the completed requests, a callback may submit the next request */
+static void client_complete(mapwize_client_s* client)
 {
-    CURL *curl;
+    mapwize_req_s** link;
+    mapwize_req_s* req;
+    CURLMsg* msg;
     CURLcode res;
-    char errbuf[CURL_ERROR_SIZE];
-    char url[96] = {0};
+    long status;
+    int msgs;
 
-    snprintf(url, sizeof(url), "https://api.mapwize.io/v1/places?api_key=%s", apikey);
+    while ((msg = curl_multi_info_read(client->multi, &msgs)) != NULL) {
+        if (msg->msg != CURLMSG_DONE)
+            continue;
+
+        res = msg->data.result;
+        req = NULL;
+        status = 0;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**)&req);
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &status);
+        curl_multi_remove_handle(client->multi, msg->easy_handle);
+
+        for (link = &client->reqs; *link != NULL && *link != req; link = &(*link)->next);
+        if (*link != NULL)
+            *link = req->next;
+        client->inflight--;
 
-    curl = curl_easy_init();
-    if(curl) {
-        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "POST");
-        curl_easy_setopt(curl, CURLOPT_URL, url);
-        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-        curl_easy_setopt(curl, CURLOPT_DEFAULT_PROTOCOL, "https");
-        curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, errbuf);
-        struct curl_slist *headers = NULL;
-        headers = curl_slist_append(headers, "Content-Type: application/json");
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-        //const char *data = "{\"name\":\"Office\",\"description\":\"Room description\",\"floor\":0,\"geometry\":{\"type\":\"Point\",\"coordinates\":[-9.137969613075256,38.713773333472425]},\"placeTypeId\":\"{{placeTypeId}}\",\"isPublished\":true,\"isSearchable\":true,\"isVisible\":true,\"isClickable\":true,\"style\":{\"markerUrl\":\"https://mapwize.blob.core.windows.net/placetypes/30/room.png\",\"markerDisplay\":true,\"strokeColor\":\"#711083\",\"strokeOpacity\":0.5,\"strokeWidth\":\"1\",\"fillColor\":\"#f23196\",\"fillOpacity\":0.5,\"labelBackgroundColor\":\"#000\",\"labelBackgroundOpacity\":1},\"searchKeywords\":\"Mr X's office,X's office\",\"translations\":[{\"title\":\"Bureau de Mr X\",\"language\":\"fr\"},{\"title\":\"Mr X's office\",\"language\":\"en\"}],\"data\":{\"ID\":\"XBCDJJD\"},\"venueId\":\"{{venueId}}\",\"owner\":\"{{organizationId}}\"}";
-        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data);
-        errbuf[0] = '\0';
-        res = curl_easy_perform(curl);
         if (res != CURLE_OK) {
-            MSG_DEBUG(LOG_WARNING, "WARNING~, create place error: %s\n", strlen(errbuf) > 1 ? errbuf : curl_easy_strerror(res));
+            MSG_DEBUG(LOG_WARNING, "WARNING~, %s error: %s\n", req->what, strlen(req->errbuf) > 1 ? req->errbuf : curl_easy_strerror(res));
         }
+
+        client_release(client, req->curl);
+
+        req->done(req->ctx, (int)res, status, req->resp.ptr ? req->resp.ptr : "", req->resp.len);
+
+        lgw_free(req->resp.ptr);
+        lgw_free(req);
     }
-    curl_easy_cleanup(curl);
-    return (int)res;
 }
 
-int mapwize_del_places(char* apikey, char* placeid) 
+int mapwize_client_run(mapwize_client_s* client, int fd, int timeout)
 {
-    CURL *curl;
-    CURLcode res;
+    struct curl_waitfd wfd;
+    int running, numfds;
+
+    curl_multi_perform(client->multi, &running);
+    client_complete(client);
 
+    wfd.fd = fd;
+    wfd.events = CURL_WAIT_POLLIN;
+    wfd.revents = 0;
+    curl_multi_poll(client->multi, fd >= 0 ? &wfd : NULL, fd >= 0 ? 1 : 0, timeout, &numfds);
+
+    curl_multi_perform(client->multi, &running);
+    client_complete(client);
+
+    return (wfd.revents & CURL_WAIT_POLLIN) ? 1 : 0;
+}
+
+int mapwize_client_inflight(const mapwize_client_s* client)
+{
+    return client->inflight;
+}
+
+int mapwize_signin(mapwize_client_s* client, char* apikey, char* email, char* passwd) 
+{
+    char url[96] = {0};
+    char data[96] = {0};
+
+    snprintf(url, sizeof(url), "https://api.mapwize.io/v1/auth/signin?api_key=%s", apikey);
+    snprintf(data, sizeof(data), "{\"email\":\"%s\", \"password\":\"%s\"}", email, passwd);
+
+    return client_perform(client, "POST", url, data, NULL, NULL, "signin");
+}
+
+
+int mapwize_get_placetype(mapwize_client_s* client, char* apikey, char* orgid, void* data)
+{
+    char url[128] = {0};
+    snprintf(url, sizeof(url), "https://api.mapwize.io/v1/placeTypes?api_key=%s&organizationId=%s", apikey, orgid);
+
+    return client_perform(client, "GET", url, NULL, curl_write_cb, data, "get placetype");
+}
+
+int mapwize_create_place(mapwize_client_s* client, char* apikey, char* data)
+{
+    char url[96] = {0};
+
+    snprintf(url, sizeof(url), "https://api.mapwize.io/v1/places?api_key=%s", apikey);
+
+    //const char *data = "{\"name\":\"Office\",\"description\":\"Room description\",\"floor\":0,\"geometry\":{\"type\":\"Point\",\"coordinates\":[-9.137969613075256,38.713773333472425]},\"placeTypeId\":\"{{placeTypeId}}\",\"isPublished\":true,\"isSearchable\":true,\"isVisible\":true,\"isClickable\":true,\"style\":{\"markerUrl\":\"https://mapwize.blob.core.windows.net/placetypes/30/room.png\",\"markerDisplay\":true,\"strokeColor\":\"#711083\",\"strokeOpacity\":0.5,\"strokeWidth\":\"1\",\"fillColor\":\"#f23196\",\"fillOpacity\":0.5,\"labelBackgroundColor\":\"#000\",\"labelBackgroundOpacity\":1},\"searchKeywords\":\"Mr X's office,X's office\",\"translations\":[{\"title\":\"Bureau de Mr X\",\"language\":\"fr\"},{\"title\":\"Mr X's office\",\"language\":\"en\"}],\"data\":{\"ID\":\"XBCDJJD\"},\"venueId\":\"{{venueId}}\",\"owner\":\"{{organizationId}}\"}";
+    return client_perform(client, "POST", url, data, NULL, NULL, "create place");
+}
+
+int mapwize_del_places(mapwize_client_s* client, char* apikey, char* placeid) 
+{
     char url[128] = {0};
     snprintf(url, sizeof(url), "https://api.mapwize.io/v1/places/%s?api_key=%s", placeid, apikey);
 
-    curl = curl_easy_init();
-    if(curl) {
-        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "DELETE");
-        curl_easy_setopt(curl, CURLOPT_URL, url);
-        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-        curl_easy_setopt(curl, CURLOPT_DEFAULT_PROTOCOL, "https");
-        struct curl_slist *headers = NULL;
-        headers = curl_slist_append(headers, "Content-Type: application/json");
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-        res = curl_easy_perform(curl);
-    }
-    curl_easy_cleanup(curl);
-    return (int)res;
+    return client_perform(client, "DELETE", url, NULL, NULL, NULL, "delete place");
 }
 
-int mapwize_create_beacons(char* apikey, char* data)
+int mapwize_create_place_async(mapwize_client_s* client, const char* apikey, const char* data, mapwize_done_cb done, void* ctx)
 {
-    CURL *curl;
-    CURLcode res;
+    char url[96] = {0};
+
+    snprintf(url, sizeof(url), "https://api.mapwize.io/v1/places?api_key=%s", apikey);
+
+    return client_submit(client, "POST", url, data, done, ctx, "create place");
+}
+
+int mapwize_update_place_async(mapwize_client_s* client, const char* apikey, const char* placeid, const char* data, mapwize_done_cb done, void* ctx)
+{
+    char url[128] = {0};
+
+    snprintf(url, sizeof(url), "https://api.mapwize.io/v1/places/%s?api_key=%s", placeid, apikey);
+
+    return client_submit(client, "PUT", url, data, done, ctx, "update place");
+}
 
+int mapwize_del_places_async(mapwize_client_s* client, const char* apikey, const char* placeid, mapwize_done_cb done, void* ctx)
+{
+    char url[128] = {0};
+
+    snprintf(url, sizeof(url), "https://api.mapwize.io/v1/places/%s?api_key=%s", placeid, apikey);
+
+    return client_submit(client, "DELETE", url, NULL, done, ctx, "delete place");
+}
+
+int mapwize_create_beacons(mapwize_client_s* client, char* apikey, char* data)
+{
     char url[96] = {0};
     snprintf(url, sizeof(url), "https://api.mapwize.io/v1/beacons?api_key=%s", apikey);
 
-    curl = curl_easy_init();
-    if(curl) {
-        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "POST");
-        curl_easy_setopt(curl, CURLOPT_URL, url);
-        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-        curl_easy_setopt(curl, CURLOPT_DEFAULT_PROTOCOL, "https");
-        struct curl_slist *headers = NULL;
-        headers = curl_slist_append(headers, "Content-Type: application/json");
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-        //const char *data = "{\"name\":\"iBeacon1\",\"type\":\"ibeacon\",\"location\":{\"lat\":38.71404746390113,\"lon\":-9.140428906009676},\"floor\":1,\"properties\":{\"uuid\":\"D94194BD-105B-4366-9785-271B25AD26C1\",\"major\":\"0\",\"minor\":\"0\"},\"venueId\":\"{{venueId}}\",\"owner\":\"{{organizationId}}\",\"isPublished\":true}";
-        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data);
-        res = curl_easy_perform(curl);
-    }
-    curl_easy_cleanup(curl);
-    return (int)res;
+    //const char *data = "{\"name\":\"iBeacon1\",\"type\":\"ibeacon\",\"location\":{\"lat\":38.71404746390113,\"lon\":-9.140428906009676},\"floor\":1,\"properties\":{\"uuid\":\"D94194BD-105B-4366-9785-271B25AD26C1\",\"major\":\"0\",\"minor\":\"0\"},\"venueId\":\"{{venueId}}\",\"owner\":\"{{organizationId}}\",\"isPublished\":true}";
+    return client_perform(client, "POST", url, data, NULL, NULL, "create beacon");
 }
 
-int mapwize_get_beacons(char* apikey, void* writedata)
+int mapwize_get_places(mapwize_client_s* client, char* apikey, char* orgid, json_stream_s* stream)
 {
-    CURL *curl;
-    CURLcode res;
+    char url[192] = {0};
+    snprintf(url, sizeof(url), "https://api.mapwize.io/v1/places?api_key=%s&organizationId=%s&isPublished=all", apikey, orgid);
+
+    return client_perform(client, "GET", url, NULL, curl_stream_cb, stream, "get places");
+}
 
+int mapwize_get_beacons(mapwize_client_s* client, char* apikey, json_stream_s* stream)
+{
     char url[96] = {0};
     snprintf(url, sizeof(url), "https://api.mapwize.io/v1/beacons?api_key=%s&isPublished=all", apikey);
 
-    curl = curl_easy_init();
-    if(curl) {
-        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "GET");
-        curl_easy_setopt(curl, CURLOPT_URL, url);
-        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-        curl_easy_setopt(curl, CURLOPT_DEFAULT_PROTOCOL, "https");
-        struct curl_slist *headers = NULL;
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curl_write_cb);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, writedata);
-        res = curl_easy_perform(curl);
-    }
-    curl_easy_cleanup(curl);
-    return (int)res;
+    return client_perform(client, "GET", url, NULL, curl_stream_cb, stream, "get beacons");
 }
-
@@ -28,6 +28,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <ctype.h>
 #include <math.h>
@@ -35,16 +36,33 @@
 #include "compiler.h"
 #include "lgwmm.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define PARSON_AVX2
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PARSON_NEON
+#endif
+
 #define STARTING_CAPACITY         15
 #define ARRAY_MAX_CAPACITY    122880 /* 15*(2^13) */
 #define OBJECT_MAX_CAPACITY      960 /* 15*(2^6)  */
+#define OBJECT_INDEX_THRESHOLD    16 /* objects from this size on get a hash index */
+#define OBJECT_INDEX_MIN_SIZE     32
+#define OBJECT_NOT_FOUND      ((size_t)-1)
 #define MAX_NESTING               19
 #define DOUBLE_SERIALIZATION_FORMAT "%f"
+#define ARENA_BLOCK_SIZE       16384
+#define ARENA_ALIGN(n)        (((n) + sizeof(double) - 1) & ~(sizeof(double) - 1))
 
 #define SIZEOF_TOKEN(a)       (sizeof(a) - 1)
 #define SKIP_CHAR(str)        ((*str)++)
-#define SKIP_WHITESPACES(str) while (isspace(**str)) { SKIP_CHAR(str); }
+#define SKIP_WHITESPACES(str) do { *(str) = skip_whitespaces(*(str)); } while (0)
 #define MAX(a, b)             ((a) > (b) ? (a) : (b))
+#define MIN(a, b)             ((a) < (b) ? (a) : (b))
 
 #undef malloc
 #undef free
@@ -74,6 +92,8 @@ struct json_object_t {
     JSON_Value **values;
     size_t       count;
     size_t       capacity;
+    size_t      *index;      /* open addressing, position of a name + 1, 0 -> free slot */
+    size_t       index_mask; /* index size - 1, index is NULL for small objects */
 };
 
 struct json_array_t {
@@ -82,6 +102,42 @@ struct json_array_t {
     size_t       capacity;
 };
 
+typedef struct json_arena_block_t {
+    struct json_arena_block_t *next;
+    size_t       size;
+    size_t       used;
+    double       data[];    /* double keeps the first allocation aligned */
+} JSON_Arena_Block;
+
+struct json_arena_t {
+    JSON_Arena_Block *head;
+    JSON_Arena_Block *current;
+    size_t       block_size;
+};
+
+/* arena of the parse running on this thread, NULL -> heap */
+static __thread JSON_Arena *parson_arena = NULL;
+
+/* 1 -> names and strings are decoded in place in the parsed buffer */
+static __thread int parson_insitu = 0;
+
+/* Arena */
+static void * arena_alloc(JSON_Arena *arena, size_t size);
+static void   arena_trim(JSON_Arena *arena, void *ptr, size_t size, size_t new_size);
+static void * json_alloc(size_t size);
+static void   json_release(void *ptr);
+
+/* Scanning kernels, picked once at startup by parson_scan_init */
+static const char * scan_whitespace_scalar(const char *s);
+static const char * scan_string_scalar(const char *s);
+static size_t       scan_ascii_scalar(const char *s, size_t len);
+static void         parson_scan_init(void) __attribute__((constructor));
+static const char * skip_whitespaces(const char *s);
+
+static const char * (*scan_whitespace)(const char *s) = scan_whitespace_scalar; /* first byte not in " \t\n\r" */
+static const char * (*scan_string)(const char *s) = scan_string_scalar;         /* first '"', '\\' or byte < 0x20 */
+static size_t       (*scan_ascii)(const char *s, size_t len) = scan_ascii_scalar; /* number of leading ascii bytes */
+
 /* Various */
 static char * read_file(const char *filename);
 static void   remove_comments(char *string, const char *start_token, const char *end_token);
@@ -97,7 +153,11 @@ static int    is_decimal(const char *string, size_t length);
 static JSON_Object * json_object_init(void);
 static JSON_Status   json_object_add(JSON_Object *object, const char *name, JSON_Value *value);
 static JSON_Status   json_object_resize(JSON_Object *object, size_t new_capacity);
+static size_t        json_object_find(const JSON_Object *object, const char *name, size_t n);
 static JSON_Value  * json_object_nget_value(const JSON_Object *object, const char *name, size_t n);
+static size_t        json_object_hash(const char *name, size_t n);
+static void          json_object_index_insert(JSON_Object *object, size_t position);
+static JSON_Status   json_object_index_build(JSON_Object *object, size_t size);
 static void          json_object_free(JSON_Object *object);
 
 /* JSON Array */
@@ -128,9 +188,273 @@ static int    json_serialize_string(const char *string, char *buf);
 static int    append_indent(char *buf, int level);
 static int    append_string(char *buf, const char *string);
 
+/* Arena */
+static void * arena_alloc(JSON_Arena *arena, size_t size) {
+    JSON_Arena_Block *block = arena->current, *new_block = NULL;
+    void *ptr = NULL;
+    size = ARENA_ALIGN(size);
+    /* blocks after current are empty after a reset, reuse them first */
+    while (block != NULL && block->size - block->used < size) {
+        if (block->next == NULL)
+            break;
+        block = block->next;
+    }
+    if (block == NULL || block->size - block->used < size) {
+        size_t block_size = MAX(arena->block_size, size);
+        new_block = (JSON_Arena_Block*)lgw_malloc(sizeof(JSON_Arena_Block) + block_size);
+        if (new_block == NULL)
+            return NULL;
+        new_block->next = NULL;
+        new_block->size = block_size;
+        new_block->used = 0;
+        if (block == NULL)
+            arena->head = new_block;
+        else
+            block->next = new_block;
+        block = new_block;
+    }
+    ptr = (unsigned char*)block->data + block->used;
+    block->used += size;
+    arena->current = block;
+    return ptr;
+}
+
+/* gives back the tail of the latest allocation */
+static void arena_trim(JSON_Arena *arena, void *ptr, size_t size, size_t new_size) {
+    JSON_Arena_Block *block = arena->current;
+    if (block == NULL || (unsigned char*)ptr + ARENA_ALIGN(size) != (unsigned char*)block->data + block->used)
+        return;
+    block->used -= ARENA_ALIGN(size) - ARENA_ALIGN(new_size);
+}
+
+static void * json_alloc(size_t size) {
+    if (parson_arena != NULL)
+        return arena_alloc(parson_arena, size);
+    return lgw_malloc(size);
+}
+
+static void json_release(void *ptr) {
+    if (parson_arena == NULL)
+        lgw_free(ptr);
+}
+
+/* Scanning kernels
+   The vector variants read whole aligned blocks, which may cover bytes after
+   the terminator but never cross a page, hence the no_sanitize_address. */
+#define IS_JSON_SPACE(c) ((c) == ' ' || (c) == '\t' || (c) == '\n' || (c) == '\r')
+
+static const char * scan_whitespace_scalar(const char *s) {
+    while (IS_JSON_SPACE(*s))
+        s++;
+    return s;
+}
+
+static const char * scan_string_scalar(const char *s) {
+    while (*s != '\"' && *s != '\\' && (unsigned char)*s >= 0x20)
+        s++;
+    return s;
+}
+
+static size_t scan_ascii_scalar(const char *s, size_t len) {
+    size_t i = 0;
+    while (i < len && (unsigned char)s[i] < 0x80)
+        i++;
+    return i;
+}
+
+#if defined(__SSE2__)
+__attribute__((no_sanitize_address))
+static const char * scan_whitespace_sse2(const char *s) {
+    const __m128i space = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t');
+    const __m128i lf = _mm_set1_epi8('\n'), cr = _mm_set1_epi8('\r');
+    __m128i block, ws;
+    unsigned int mask;
+    while (((uintptr_t)s & 15) != 0) {
+        if (!IS_JSON_SPACE(*s))
+            return s;
+        s++;
+    }
+    for (;;) {
+        block = _mm_load_si128((const __m128i*)s);
+        ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, space), _mm_cmpeq_epi8(block, tab)),
+                          _mm_or_si128(_mm_cmpeq_epi8(block, lf), _mm_cmpeq_epi8(block, cr)));
+        mask = ~(unsigned int)_mm_movemask_epi8(ws) & 0xFFFF;
+        if (mask != 0)
+            return s + __builtin_ctz(mask);
+        s += 16;
+    }
+}
+
+__attribute__((no_sanitize_address))
+static const char * scan_string_sse2(const char *s) {
+    const __m128i quote = _mm_set1_epi8('\"'), backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1F);
+    __m128i block, hit;
+    unsigned int mask;
+    while (((uintptr_t)s & 15) != 0) {
+        if (*s == '\"' || *s == '\\' || (unsigned char)*s < 0x20)
+            return s;
+        s++;
+    }
+    for (;;) {
+        block = _mm_load_si128((const __m128i*)s);
+        hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, quote), _mm_cmpeq_epi8(block, backslash)),
+                           _mm_cmpeq_epi8(_mm_max_epu8(block, control), control)); /* <= 0x1F */
+        mask = (unsigned int)_mm_movemask_epi8(hit);
+        if (mask != 0)
+            return s + __builtin_ctz(mask);
+        s += 16;
+    }
+}
+
+static size_t scan_ascii_sse2(const char *s, size_t len) {
+    size_t i = 0;
+    while (i + 16 <= len && _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(s + i))) == 0)
+        i += 16;
+    return i + scan_ascii_scalar(s + i, len - i);
+}
+#endif
+
+#if defined(PARSON_AVX2)
+__attribute__((target("avx2"), no_sanitize_address))
+static const char * scan_whitespace_avx2(const char *s) {
+    const __m256i space = _mm256_set1_epi8(' '), tab = _mm256_set1_epi8('\t');
+    const __m256i lf = _mm256_set1_epi8('\n'), cr = _mm256_set1_epi8('\r');
+    __m256i block, ws;
+    unsigned int mask;
+    while (((uintptr_t)s & 31) != 0) {
+        if (!IS_JSON_SPACE(*s))
+            return s;
+        s++;
+    }
+    for (;;) {
+        block = _mm256_load_si256((const __m256i*)s);
+        ws = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(block, space), _mm256_cmpeq_epi8(block, tab)),
+                             _mm256_or_si256(_mm256_cmpeq_epi8(block, lf), _mm256_cmpeq_epi8(block, cr)));
+        mask = ~(unsigned int)_mm256_movemask_epi8(ws);
+        if (mask != 0)
+            return s + __builtin_ctz(mask);
+        s += 32;
+    }
+}
+
+__attribute__((target("avx2"), no_sanitize_address))
+static const char * scan_string_avx2(const char *s) {
+    const __m256i quote = _mm256_set1_epi8('\"'), backslash = _mm256_set1_epi8('\\');
+    const __m256i control = _mm256_set1_epi8(0x1F);
+    __m256i block, hit;
+    unsigned int mask;
+    while (((uintptr_t)s & 31) != 0) {
+        if (*s == '\"' || *s == '\\' || (unsigned char)*s < 0x20)
+            return s;
+        s++;
+    }
+    for (;;) {
+        block = _mm256_load_si256((const __m256i*)s);
+        hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(block, quote), _mm256_cmpeq_epi8(block, backslash)),
+                              _mm256_cmpeq_epi8(_mm256_max_epu8(block, control), control));
+        mask = (unsigned int)_mm256_movemask_epi8(hit);
+        if (mask != 0)
+            return s + __builtin_ctz(mask);
+        s += 32;
+    }
+}
+
+__attribute__((target("avx2")))
+static size_t scan_ascii_avx2(const char *s, size_t len) {
+    size_t i = 0;
+    while (i + 32 <= len && _mm256_movemask_epi8(_mm256_loadu_si256((const __m256i*)(s + i))) == 0)
+        i += 32;
+    return i + scan_ascii_scalar(s + i, len - i);
+}
+#endif
+
+#if defined(PARSON_NEON)
+/* first set byte of a compare result, the 128 bit mask is narrowed to 4 bits a byte */
+static inline int neon_first(uint8x16_t hit) {
+    uint64_t bits = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(hit), 4)), 0);
+    return bits ? __builtin_ctzll(bits) >> 2 : -1;
+}
+
+__attribute__((no_sanitize_address))
+static const char * scan_whitespace_neon(const char *s) {
+    uint8x16_t block, ws;
+    int first;
+    while (((uintptr_t)s & 15) != 0) {
+        if (!IS_JSON_SPACE(*s))
+            return s;
+        s++;
+    }
+    for (;;) {
+        block = vld1q_u8((const uint8_t*)s);
+        ws = vorrq_u8(vorrq_u8(vceqq_u8(block, vdupq_n_u8(' ')), vceqq_u8(block, vdupq_n_u8('\t'))),
+                      vorrq_u8(vceqq_u8(block, vdupq_n_u8('\n')), vceqq_u8(block, vdupq_n_u8('\r'))));
+        if ((first = neon_first(vmvnq_u8(ws))) >= 0)
+            return s + first;
+        s += 16;
+    }
+}
+
+__attribute__((no_sanitize_address))
+static const char * scan_string_neon(const char *s) {
+    uint8x16_t block, hit;
+    int first;
+    while (((uintptr_t)s & 15) != 0) {
+        if (*s == '\"' || *s == '\\' || (unsigned char)*s < 0x20)
+            return s;
+        s++;
+    }
+    for (;;) {
+        block = vld1q_u8((const uint8_t*)s);
+        hit = vorrq_u8(vorrq_u8(vceqq_u8(block, vdupq_n_u8('\"')), vceqq_u8(block, vdupq_n_u8('\\'))),
+                       vcltq_u8(block, vdupq_n_u8(0x20)));
+        if ((first = neon_first(hit)) >= 0)
+            return s + first;
+        s += 16;
+    }
+}
+
+static size_t scan_ascii_neon(const char *s, size_t len) {
+    size_t i = 0;
+    while (i + 16 <= len && neon_first(vcgeq_u8(vld1q_u8((const uint8_t*)(s + i)), vdupq_n_u8(0x80))) < 0)
+        i += 16;
+    return i + scan_ascii_scalar(s + i, len - i);
+}
+#endif
+
+static void parson_scan_init(void) {
+#if defined(PARSON_AVX2)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        scan_whitespace = scan_whitespace_avx2;
+        scan_string = scan_string_avx2;
+        scan_ascii = scan_ascii_avx2;
+        return;
+    }
+#endif
+#if defined(__SSE2__)
+    scan_whitespace = scan_whitespace_sse2;
+    scan_string = scan_string_sse2;
+    scan_ascii = scan_ascii_sse2;
+#elif defined(PARSON_NEON)
+    scan_whitespace = scan_whitespace_neon;
+    scan_string = scan_string_neon;
+    scan_ascii = scan_ascii_neon;
+#endif
+}
+
+static const char * skip_whitespaces(const char *s) {
+    if (!isspace((unsigned char)*s))   /* most calls have nothing to skip */
+        return s;
+    s = scan_whitespace(s);
+    while (isspace((unsigned char)*s)) /* \v and \f, accepted as before */
+        s = scan_whitespace(s + 1);
+    return s;
+}
+
 /* Various */
 static char * parson_strndup(const char *string, size_t n) {
-    char *output_string = (char*)lgw_malloc(n + 1);
+    char *output_string = (char*)json_alloc(n + 1);
     if (!output_string)
         return NULL;
     output_string[n] = '\0';
@@ -207,6 +531,9 @@ static int is_valid_utf8(const char *string, size_t string_len) {
     int len = 0;
     const char *string_end =  string + string_len;
     while (string < string_end) {
+        string += scan_ascii(string, string_end - string);
+        if (string == string_end)
+            break;
         if (!verify_utf8_sequence((const unsigned char*)string, &len)) {
             return 0;
         }
@@ -291,13 +618,15 @@ static void remove_comments(char *string, const char *start_token, const char *e
 
 /* JSON Object */
 static JSON_Object * json_object_init(void) {
-    JSON_Object *new_obj = (JSON_Object*)lgw_malloc(sizeof(JSON_Object));
+    JSON_Object *new_obj = (JSON_Object*)json_alloc(sizeof(JSON_Object));
     if (!new_obj)
         return NULL;
     new_obj->names = (char**)NULL;
     new_obj->values = (JSON_Value**)NULL;
     new_obj->capacity = 0;
     new_obj->count = 0;
+    new_obj->index = (size_t*)NULL;
+    new_obj->index_mask = 0;
     return new_obj;
 }
 
@@ -316,11 +645,17 @@ static JSON_Status json_object_add(JSON_Object *object, const char *name, JSON_V
     if (json_object_get_value(object, name) != NULL)
         return JSONFailure;
     index = object->count;
-    object->names[index] = parson_strdup(name);
+    object->names[index] = parson_insitu ? (char*)name : parson_strdup(name);
     if (object->names[index] == NULL)
         return JSONFailure;
     object->values[index] = value;
     object->count++;
+    if (object->index != NULL && object->count * 2 <= object->index_mask + 1) {
+        json_object_index_insert(object, index);
+    } else if (object->count >= OBJECT_INDEX_THRESHOLD) {
+        /* no index yet or above half load, lookups stay linear if this fails */
+        json_object_index_build(object, object->count * 2);
+    }
     return JSONSuccess;
 }
 
@@ -334,13 +669,13 @@ static JSON_Status json_object_resize(JSON_Object *object, size_t new_capacity)
             return JSONFailure; /* Shouldn't happen */
     }
 
-    temp_names = (char**)lgw_malloc(new_capacity * sizeof(char*));
+    temp_names = (char**)json_alloc(new_capacity * sizeof(char*));
     if (temp_names == NULL)
         return JSONFailure;
 
-    temp_values = (JSON_Value**)lgw_malloc(new_capacity * sizeof(JSON_Value*));
+    temp_values = (JSON_Value**)json_alloc(new_capacity * sizeof(JSON_Value*));
     if (temp_values == NULL) {
-        lgw_free(temp_names);
+        json_release(temp_names);
         return JSONFailure;
     }
 
@@ -348,39 +683,95 @@ static JSON_Status json_object_resize(JSON_Object *object, size_t new_capacity)
         memcpy(temp_names, object->names, object->count * sizeof(char*));
         memcpy(temp_values, object->values, object->count * sizeof(JSON_Value*));
     }
-    lgw_free(object->names);
-    lgw_free(object->values);
+    json_release(object->names);
+    json_release(object->values);
     object->names = temp_names;
     object->values = temp_values;
     object->capacity = new_capacity;
     return JSONSuccess;
 }
 
-static JSON_Value * json_object_nget_value(const JSON_Object *object, const char *name, size_t n) {
-    size_t i, name_length;
-    for (i = 0; i < json_object_get_count(object); i++) {
-        name_length = strlen(object->names[i]);
-        if (name_length != n)
+static size_t json_object_find(const JSON_Object *object, const char *name, size_t n) {
+    size_t i, slot;
+    if (object == NULL)
+        return OBJECT_NOT_FOUND;
+    if (object->index != NULL) {
+        slot = json_object_hash(name, n) & object->index_mask;
+        while ((i = object->index[slot]) != 0) {
+            i -= 1;
+            if (strncmp(object->names[i], name, n) == 0 && object->names[i][n] == '\0')
+                return i;
+            slot = (slot + 1) & object->index_mask;
+        }
+        return OBJECT_NOT_FOUND;
+    }
+    for (i = 0; i < object->count; i++) {
+        if (n > 0 && object->names[i][0] != name[0])
             continue;
-        if (strncmp(object->names[i], name, n) == 0)
-            return object->values[i];
+        if (strncmp(object->names[i], name, n) == 0 && object->names[i][n] == '\0')
+            return i;
     }
-    return NULL;
+    return OBJECT_NOT_FOUND;
+}
+
+static JSON_Value * json_object_nget_value(const JSON_Object *object, const char *name, size_t n) {
+    size_t i = json_object_find(object, name, n);
+    return i == OBJECT_NOT_FOUND ? NULL : object->values[i];
+}
+
+static size_t json_object_hash(const char *name, size_t n) {
+    size_t hash = 2166136261u; /* FNV-1a */
+    while (n--) {
+        hash ^= (unsigned char)*name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void json_object_index_insert(JSON_Object *object, size_t position) {
+    const char *name = object->names[position];
+    size_t slot = json_object_hash(name, strlen(name)) & object->index_mask;
+    while (object->index[slot] != 0)
+        slot = (slot + 1) & object->index_mask;
+    object->index[slot] = position + 1;
+}
+
+/* (re)builds the index with at least size slots, size 0 keeps the current slots */
+static JSON_Status json_object_index_build(JSON_Object *object, size_t size) {
+    size_t i, index_size = OBJECT_INDEX_MIN_SIZE;
+    size_t *new_index = NULL;
+    if (size == 0 && object->index != NULL) {
+        memset(object->index, 0, (object->index_mask + 1) * sizeof(size_t));
+    } else {
+        while (index_size < size)
+            index_size <<= 1;
+        new_index = (size_t*)json_alloc(index_size * sizeof(size_t));
+        json_release(object->index);
+        object->index = new_index;
+        if (new_index == NULL)
+            return JSONFailure;
+        memset(new_index, 0, index_size * sizeof(size_t));
+        object->index_mask = index_size - 1;
+    }
+    for (i = 0; i < object->count; i++)
+        json_object_index_insert(object, i);
+    return JSONSuccess;
 }
 
 static void json_object_free(JSON_Object *object) {
     while(object->count--) {
-        lgw_free(object->names[object->count]);
+        json_release(object->names[object->count]);
         json_value_free(object->values[object->count]);
     }
-    lgw_free(object->names);
-    lgw_free(object->values);
-    lgw_free(object);
+    json_release(object->names);
+    json_release(object->values);
+    json_release(object->index);
+    json_release(object);
 }
 
 /* JSON Array */
 static JSON_Array * json_array_init(void) {
-    JSON_Array *new_array = (JSON_Array*)lgw_malloc(sizeof(JSON_Array));
+    JSON_Array *new_array = (JSON_Array*)json_alloc(sizeof(JSON_Array));
     if (!new_array)
         return NULL;
     new_array->items = (JSON_Value**)NULL;
@@ -407,14 +798,14 @@ static JSON_Status json_array_resize(JSON_Array *array, size_t new_capacity) {
     if (new_capacity == 0) {
         return JSONFailure;
     }
-    new_items = (JSON_Value**)lgw_malloc(new_capacity * sizeof(JSON_Value*));
+    new_items = (JSON_Value**)json_alloc(new_capacity * sizeof(JSON_Value*));
     if (new_items == NULL) {
         return JSONFailure;
     }
     if (array->items != NULL && array->count > 0) {
         memcpy(new_items, array->items, array->count * sizeof(JSON_Value*));
     }
-    lgw_free(array->items);
+    json_release(array->items);
     array->items = new_items;
     array->capacity = new_capacity;
     return JSONSuccess;
@@ -423,13 +814,13 @@ static JSON_Status json_array_resize(JSON_Array *array, size_t new_capacity) {
 static void json_array_free(JSON_Array *array) {
     while (array->count--)
         json_value_free(array->items[array->count]);
-    lgw_free(array->items);
-    lgw_free(array);
+    json_release(array->items);
+    json_release(array);
 }
 
 /* JSON Value */
 static JSON_Value * json_value_init_string_no_copy(char *string) {
-    JSON_Value *new_value = (JSON_Value*)lgw_malloc(sizeof(JSON_Value));
+    JSON_Value *new_value = (JSON_Value*)json_alloc(sizeof(JSON_Value));
     if (!new_value)
         return NULL;
     new_value->type = JSONString;
@@ -440,17 +831,25 @@ static JSON_Value * json_value_init_string_no_copy(char *string) {
 /* Parser */
 static void skip_quotes(const char **string) {
     SKIP_CHAR(string);
-    while (**string != '\"') {
-        if (**string == '\0')
-            return;
-        if (**string == '\\') {
-            SKIP_CHAR(string);
-            if (**string == '\0')
+    for (;;) {
+        *string = scan_string(*string);
+        switch (**string) {
+            case '\"':
+                SKIP_CHAR(string);
+                return;
+            case '\0':
                 return;
+            case '\\':
+                SKIP_CHAR(string);
+                if (**string == '\0')
+                    return;
+                SKIP_CHAR(string);
+                break;
+            default: /* control character, process_string rejects it */
+                SKIP_CHAR(string);
+                break;
         }
-        SKIP_CHAR(string);
     }
-    SKIP_CHAR(string);
 }
 
 static int parse_utf_16(const char **unprocessed, char **processed) {
@@ -494,15 +893,28 @@ static int parse_utf_16(const char **unprocessed, char **processed) {
 
 
 /* Copies and processes passed string up to supplied length.
-Example: "\u006Corem ipsum" -> lorem ipsum */
+Example: "\u006Corem ipsum" -> lorem ipsum
+In situ the output overwrites the input, it never gets ahead of it. */
 static char* process_string(const char *input, size_t len) {
     const char *input_ptr = input;
     size_t initial_size = (len + 1) * sizeof(char);
     size_t final_size = 0;
-    char *output = (char*)lgw_malloc(initial_size);
+    char *output = parson_insitu ? (char*)input : (char*)json_alloc(initial_size);
     char *output_ptr = output;
     char *resized_output = NULL;
+    size_t run = 0;
+    if (output == NULL)
+        return NULL;
     while ((*input_ptr != '\0') && (size_t)(input_ptr - input) < len) {
+        run = scan_string(input_ptr) - input_ptr; /* plain characters are copied at once */
+        if (run > 0) {
+            run = MIN(run, len - (size_t)(input_ptr - input));
+            if (output_ptr != input_ptr)
+                memmove(output_ptr, input_ptr, run);
+            output_ptr += run;
+            input_ptr += run;
+            continue;
+        }
         if (*input_ptr == '\\') {
             input_ptr++;
             switch (*input_ptr) {
@@ -532,6 +944,12 @@ static char* process_string(const char *input, size_t len) {
     *output_ptr = '\0';
     /* resize to new length */
     final_size = (size_t)(output_ptr-output) + 1;
+    if (parson_insitu)
+        return output;
+    if (parson_arena != NULL) {
+        arena_trim(parson_arena, output, initial_size, final_size);
+        return output;
+    }
     resized_output = (char*)lgw_malloc(final_size);
     if (resized_output == NULL)
         goto error;
@@ -539,7 +957,8 @@ static char* process_string(const char *input, size_t len) {
     lgw_free(output);
     return resized_output;
 error:
-    lgw_free(output);
+    if (!parson_insitu)
+        json_release(output);
     return NULL;
 }
 
@@ -601,17 +1020,17 @@ static JSON_Value * parse_object_value(const char **string, size_t nesting) {
         SKIP_CHAR(string);
         new_value = parse_value(string, nesting);
         if (new_value == NULL) {
-            lgw_free(new_key);
+            json_release(new_key);
             json_value_free(output_value);
             return NULL;
         }
         if(json_object_add(output_object, new_key, new_value) == JSONFailure) {
-            lgw_free(new_key);
-            lgw_free(new_value);
+            json_release(new_key);
+            json_release(new_value);
             json_value_free(output_value);
             return NULL;
         }
-        lgw_free(new_key);
+        json_release(new_key);
         SKIP_WHITESPACES(string);
         if (**string != ',')
             break;
@@ -619,8 +1038,8 @@ static JSON_Value * parse_object_value(const char **string, size_t nesting) {
         SKIP_WHITESPACES(string);
     }
     SKIP_WHITESPACES(string);
-    if (**string != '}' || /* Trim object after parsing is over */
-        json_object_resize(output_object, json_object_get_count(output_object)) == JSONFailure) {
+    if (**string != '}' || /* Trim object after parsing is over, not worth a copy in an arena */
+        (parson_arena == NULL && json_object_resize(output_object, json_object_get_count(output_object)) == JSONFailure)) {
             json_value_free(output_value);
             return NULL;
     }
@@ -646,7 +1065,7 @@ static JSON_Value * parse_array_value(const char **string, size_t nesting) {
             return NULL;
         }
         if(json_array_add(output_array, new_array_value) == JSONFailure) {
-            lgw_free(new_array_value);
+            json_release(new_array_value);
             json_value_free(output_value);
             return NULL;
         }
@@ -657,8 +1076,8 @@ static JSON_Value * parse_array_value(const char **string, size_t nesting) {
         SKIP_WHITESPACES(string);
     }
     SKIP_WHITESPACES(string);
-    if (**string != ']' || /* Trim array after parsing is over */
-        json_array_resize(output_array, json_array_get_count(output_array)) == JSONFailure) {
+    if (**string != ']' || /* Trim array after parsing is over, not worth a copy in an arena */
+        (parson_arena == NULL && json_array_resize(output_array, json_array_get_count(output_array)) == JSONFailure)) {
             json_value_free(output_value);
             return NULL;
     }
@@ -673,7 +1092,7 @@ static JSON_Value * parse_string_value(const char **string) {
         return NULL;
     value = json_value_init_string_no_copy(new_string);
     if (value == NULL) {
-        lgw_free(new_string);
+        json_release(new_string);
         return NULL;
     }
     return value;
@@ -692,10 +1111,86 @@ static JSON_Value * parse_boolean_value(const char **string) {
     return NULL;
 }
 
+/* Exact powers of ten, a double holds them without rounding up to 1e22 */
+static const double exact_pow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+#define MAX_EXACT_MANTISSA    (1ULL << 53)
+#define MAX_MANTISSA_DIGITS   19
+
+/* Parses -?int(.frac)?([eE][+-]?exp)? without strtod when the result is exact:
+   a mantissa up to 2^53 scaled by 10^-22..10^22 is one correctly rounded
+   multiplication or division (Clinger). Returns 0 when strtod has to decide. */
+static int parse_number_fast(const char *string, double *number, const char **end) {
+    const char *p = string;
+    uint64_t mantissa = 0;
+    int digits = 0, exponent = 0, exp_value = 0, negative = 0, exp_negative = 0;
+    if (*p == '-') {
+        negative = 1;
+        p++;
+    }
+    if (*p < '0' || *p > '9')
+        return 0;
+    while (*p >= '0' && *p <= '9') {
+        if (mantissa != 0 || *p != '0')
+            digits++;
+        mantissa = mantissa * 10 + (uint64_t)(*p++ - '0');
+        if (digits > MAX_MANTISSA_DIGITS)
+            return 0;
+    }
+    if (*p == '.') {
+        p++;
+        if (*p < '0' || *p > '9')
+            return 0;
+        while (*p >= '0' && *p <= '9') {
+            if (mantissa != 0 || *p != '0')
+                digits++;
+            mantissa = mantissa * 10 + (uint64_t)(*p++ - '0');
+            exponent--;
+            if (digits > MAX_MANTISSA_DIGITS)
+                return 0;
+        }
+    }
+    if (*p == 'e' || *p == 'E') {
+        p++;
+        if (*p == '-' || *p == '+')
+            exp_negative = (*p++ == '-');
+        if (*p < '0' || *p > '9')
+            return 0;
+        while (*p >= '0' && *p <= '9') {
+            exp_value = exp_value * 10 + (*p++ - '0');
+            if (exp_value > 1000)
+                return 0;
+        }
+        exponent += exp_negative ? -exp_value : exp_value;
+    }
+    if (mantissa > MAX_EXACT_MANTISSA || exponent < -22 || exponent > 22)
+        return 0;
+    *number = (double)mantissa;
+    if (exponent < 0)
+        *number /= exact_pow10[-exponent];
+    else
+        *number *= exact_pow10[exponent];
+    if (negative)
+        *number = -*number;
+    *end = p;
+    return 1;
+}
+
 static JSON_Value * parse_number_value(const char **string) {
+    const char *fast_end = NULL;
     char *end;
-    double number = strtod(*string, &end);
+    double number;
     JSON_Value *output_value;
+    if (parse_number_fast(*string, &number, &fast_end)) {
+        if (!is_decimal(*string, fast_end - *string))
+            return NULL;
+        *string = fast_end;
+        return json_value_init_number(number);
+    }
+    number = strtod(*string, &end);
     if (is_decimal(*string, end - *string)) {
         *string = end;
         output_value = json_value_init_number(number);
@@ -914,24 +1409,105 @@ JSON_Value * json_parse_string(const char *string) {
 }
 
 JSON_Value * json_parse_string_with_comments(const char *string) {
+    if (string == NULL)
+        return NULL;
+    return json_parse_stringn_with_comments(string, strlen(string));
+}
+
+JSON_Value * json_parse_stringn_with_comments(const char *string, size_t len) {
     JSON_Value *result = NULL;
     char *string_mutable_copy = NULL, *string_mutable_copy_ptr = NULL;
-    string_mutable_copy = parson_strdup(string);
+    string_mutable_copy = parson_strndup(string, len);
     if (string_mutable_copy == NULL)
         return NULL;
     remove_comments(string_mutable_copy, "/*", "*/");
     remove_comments(string_mutable_copy, "//", "\n");
     string_mutable_copy_ptr = string_mutable_copy;
-    SKIP_WHITESPACES(&string_mutable_copy_ptr);
+    SKIP_WHITESPACES((const char**)&string_mutable_copy_ptr);
     if (*string_mutable_copy_ptr != '{' && *string_mutable_copy_ptr != '[') {
-        lgw_free(string_mutable_copy);
+        json_release(string_mutable_copy);
         return NULL;
     }
     result = parse_value((const char**)&string_mutable_copy_ptr, 0);
-    lgw_free(string_mutable_copy);
+    json_release(string_mutable_copy);
+    return result;
+}
+
+JSON_Value * json_parse_string_arena(const char *string, JSON_Arena *arena) {
+    JSON_Value *result = NULL;
+    JSON_Arena *previous = parson_arena;
+    if (arena == NULL)
+        return NULL;
+    parson_arena = arena;
+    result = json_parse_string(string);
+    parson_arena = previous;
+    return result;
+}
+
+JSON_Value * json_parse_stringn_with_comments_arena(const char *string, size_t len, JSON_Arena *arena) {
+    JSON_Value *result = NULL;
+    JSON_Arena *previous = parson_arena;
+    if (arena == NULL)
+        return NULL;
+    parson_arena = arena;
+    result = json_parse_stringn_with_comments(string, len);
+    parson_arena = previous;
     return result;
 }
 
+JSON_Value * json_parse_string_insitu(char *string, JSON_Arena *arena) {
+    JSON_Value *result = NULL;
+    JSON_Arena *previous = parson_arena;
+    int previous_insitu = parson_insitu;
+    if (arena == NULL)
+        return NULL;
+    parson_arena = arena;
+    parson_insitu = 1;
+    result = json_parse_string(string);
+    parson_arena = previous;
+    parson_insitu = previous_insitu;
+    return result;
+}
+
+JSON_Value * json_parse_string_with_comments_insitu(char *string, JSON_Arena *arena) {
+    if (string == NULL)
+        return NULL;
+    remove_comments(string, "/*", "*/");
+    remove_comments(string, "//", "\n");
+    return json_parse_string_insitu(string, arena);
+}
+
+/* Arena API */
+JSON_Arena * json_arena_new(size_t block_size) {
+    JSON_Arena *arena = (JSON_Arena*)lgw_malloc(sizeof(JSON_Arena));
+    if (arena == NULL)
+        return NULL;
+    arena->head = NULL;
+    arena->current = NULL;
+    arena->block_size = block_size ? block_size : ARENA_BLOCK_SIZE;
+    return arena;
+}
+
+void json_arena_reset(JSON_Arena *arena) {
+    JSON_Arena_Block *block;
+    if (arena == NULL)
+        return;
+    for (block = arena->head; block != NULL; block = block->next)
+        block->used = 0;
+    arena->current = arena->head;
+}
+
+void json_arena_free(JSON_Arena *arena) {
+    JSON_Arena_Block *block;
+    if (arena == NULL)
+        return;
+    while ((block = arena->head) != NULL) {
+        arena->head = block->next;
+        lgw_free(block);
+    }
+    lgw_free(arena);
+}
+
 
 /* JSON Object API */
 
@@ -1061,7 +1637,7 @@ void json_value_free(JSON_Value *value) {
             json_object_free(value->value.object);
             break;
         case JSONString:
-            if (value->value.string) { lgw_free(value->value.string); }
+            if (value->value.string) { json_release(value->value.string); }
             break;
         case JSONArray:
             json_array_free(value->value.array);
@@ -1069,30 +1645,30 @@ void json_value_free(JSON_Value *value) {
         default:
             break;
     }
-    lgw_free(value);
+    json_release(value);
 }
 
 JSON_Value * json_value_init_object(void) {
-    JSON_Value *new_value = (JSON_Value*)lgw_malloc(sizeof(JSON_Value));
+    JSON_Value *new_value = (JSON_Value*)json_alloc(sizeof(JSON_Value));
     if (!new_value)
         return NULL;
     new_value->type = JSONObject;
     new_value->value.object = json_object_init();
     if (!new_value->value.object) {
-        lgw_free(new_value);
+        json_release(new_value);
         return NULL;
     }
     return new_value;
 }
 
 JSON_Value * json_value_init_array(void) {
-    JSON_Value *new_value = (JSON_Value*)lgw_malloc(sizeof(JSON_Value));
+    JSON_Value *new_value = (JSON_Value*)json_alloc(sizeof(JSON_Value));
     if (!new_value)
         return NULL;
     new_value->type = JSONArray;
     new_value->value.array = json_array_init();
     if (!new_value->value.array) {
-        lgw_free(new_value);
+        json_release(new_value);
         return NULL;
     }
     return new_value;
@@ -1112,12 +1688,12 @@ JSON_Value * json_value_init_string(const char *string) {
         return NULL;
     value = json_value_init_string_no_copy(copy);
     if (value == NULL)
-        lgw_free(copy);
+        json_release(copy);
     return value;
 }
 
 JSON_Value * json_value_init_number(double number) {
-    JSON_Value *new_value = (JSON_Value*)lgw_malloc(sizeof(JSON_Value));
+    JSON_Value *new_value = (JSON_Value*)json_alloc(sizeof(JSON_Value));
     if (!new_value)
         return NULL;
     new_value->type = JSONNumber;
@@ -1126,7 +1702,7 @@ JSON_Value * json_value_init_number(double number) {
 }
 
 JSON_Value * json_value_init_boolean(int boolean) {
-    JSON_Value *new_value = (JSON_Value*)lgw_malloc(sizeof(JSON_Value));
+    JSON_Value *new_value = (JSON_Value*)json_alloc(sizeof(JSON_Value));
     if (!new_value)
         return NULL;
     new_value->type = JSONBoolean;
@@ -1135,7 +1711,7 @@ JSON_Value * json_value_init_boolean(int boolean) {
 }
 
 JSON_Value * json_value_init_null(void) {
-    JSON_Value *new_value = (JSON_Value*)lgw_malloc(sizeof(JSON_Value));
+    JSON_Value *new_value = (JSON_Value*)json_alloc(sizeof(JSON_Value));
     if (!new_value)
         return NULL;
     new_value->type = JSONNull;
@@ -1467,15 +2043,12 @@ JSON_Status json_object_set_value(JSON_Object *object, const char *name, JSON_Va
     JSON_Value *old_value;
     if (object == NULL || name == NULL || value == NULL)
         return JSONFailure;
-    old_value = json_object_get_value(object, name);
-    if (old_value != NULL) { /* free and overwrite old value */
+    i = json_object_find(object, name, strlen(name));
+    if (i != OBJECT_NOT_FOUND) { /* free and overwrite old value */
+        old_value = object->values[i];
         json_value_free(old_value);
-        for (i = 0; i < json_object_get_count(object); i++) {
-            if (strcmp(object->names[i], name) == 0) {
-                object->values[i] = value;
-                return JSONSuccess;
-            }
-        }
+        object->values[i] = value;
+        return JSONSuccess;
     }
     /* add new key value pair */
     return json_object_add(object, name, value);
@@ -1574,22 +2147,22 @@ JSON_Status json_object_dotset_null(JSON_Object *object, const char *name) {
 
 JSON_Status json_object_remove(JSON_Object *object, const char *name) {
     size_t i = 0, last_item_index = 0;
-    if (object == NULL || json_object_get_value(object, name) == NULL)
+    if (object == NULL || name == NULL)
+        return JSONFailure;
+    i = json_object_find(object, name, strlen(name));
+    if (i == OBJECT_NOT_FOUND)
         return JSONFailure;
     last_item_index = json_object_get_count(object) - 1;
-    for (i = 0; i < json_object_get_count(object); i++) {
-        if (strcmp(object->names[i], name) == 0) {
-            lgw_free(object->names[i]);
-            json_value_free(object->values[i]);
-            if (i != last_item_index) { /* Replace key value pair with one from the end */
-                object->names[i] = object->names[last_item_index];
-                object->values[i] = object->values[last_item_index];
-            }
-            object->count -= 1;
-            return JSONSuccess;
-        }
-    }
-    return JSONFailure; /* No execution path should end here */
+    lgw_free(object->names[i]);
+    json_value_free(object->values[i]);
+    if (i != last_item_index) { /* Replace key value pair with one from the end */
+        object->names[i] = object->names[last_item_index];
+        object->values[i] = object->values[last_item_index];
+    }
+    object->count -= 1;
+    if (object->index != NULL) /* positions moved, rehash in place */
+        json_object_index_build(object, 0);
+    return JSONSuccess;
 }
 
 JSON_Status json_object_dotremove(JSON_Object *object, const char *name) {
@@ -1620,6 +2193,8 @@ JSON_Status json_object_clear(JSON_Object *object) {
         json_value_free(object->values[i]);
     }
     object->count = 0;
+    if (object->index != NULL)
+        json_object_index_build(object, 0);
     return JSONSuccess;
 }
 
@@ -0,0 +1,169 @@
+/*
+ *  ____  ____      _    ____ ___ _   _  ___
+ *  |  _ \|  _ \    / \  / ___|_ _| \ | |/ _ \
+ *  | | | | |_) |  / _ \| |  _ | ||  \| | | | |
+ *  | |_| |  _ <  / ___ \ |_| || || |\  | |_| |
+ *  |____/|_| \_\/_/   \_\____|___|_| \_|\___/
+ *
+ * location service -- An opensource of lorawan location service
+ *
+ * See http://www.dragino.com for more information about
+ * the lora gateway project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ *
+ * Maintainer: skerlan
+ *
+ */
+
+/*! \file
+ *
+ * \brief bounded multi-producer / single-consumer ring buffer
+ *
+ * Every slot carries a sequence number (Vyukov bounded queue):
+ *  seq == pos           slot is free for the producer claiming pos
+ *  seq == pos + 1       slot holds the element of pos, ready for the consumer
+ *  seq == pos + count   slot was drained, free for the next lap
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "utilities.h"
+#include "ringbuf.h"
+
+#define SLOT(ring, pos) ((ring_slot_s*)((ring)->slots + ((pos) & (ring)->mask) * (ring)->slotsize))
+
+int lgw_ring_init(lgw_ring_s* ring, size_t count, size_t elemsize)
+{
+    size_t i, size = 2;
+
+    while (size < count)
+        size <<= 1;
+
+    memset(ring, 0, sizeof(lgw_ring_s));
+
+    ring->mask = size - 1;
+    ring->elemsize = elemsize;
+    ring->slotsize = (sizeof(ring_slot_s) + elemsize + sizeof(size_t) - 1) & ~(sizeof(size_t) - 1);
+    ring->slots = lgw_malloc(size * ring->slotsize);
+    if (ring->slots == NULL)
+        return -1;
+
+    for (i = 0; i < size; i++)
+        SLOT(ring, i)->seq = i;
+
+    ring->efd = lgw_eventfd_create();
+    if (ring->efd < 0) {
+        lgw_free(ring->slots);
+        ring->slots = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+void lgw_ring_destroy(lgw_ring_s* ring)
+{
+    close(ring->efd);
+    ring->efd = -1;
+    lgw_free(ring->slots);
+    ring->slots = NULL;
+}
+
+int lgw_ring_push(lgw_ring_s* ring, const void* elem)
+{
+    ring_slot_s* slot;
+    size_t pos, seq;
+    intptr_t dif;
+
+    pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    for (;;) {
+        slot = SLOT(ring, pos);
+        seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        dif = (intptr_t)seq - (intptr_t)pos;
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&ring->head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if (dif < 0) {   // full, the consumer has not drained this slot yet
+            __atomic_add_fetch(&ring->drops, 1, __ATOMIC_RELAXED);
+            return -1;
+        } else
+            pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    }
+
+    memcpy(slot->data, elem, ring->elemsize);
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&ring->pushed, 1, __ATOMIC_RELAXED);
+
+    /* only pay for the doorbell when the consumer went to sleep */
+    if (__atomic_exchange_n(&ring->sleeping, 0, __ATOMIC_SEQ_CST))
+        lgw_eventfd_post(ring->efd);
+
+    return 0;
+}
+
+size_t lgw_ring_drain(lgw_ring_s* ring, void* out, size_t max)
+{
+    ring_slot_s* slot;
+    size_t n, pos = ring->tail;
+    unsigned char* dst = out;
+
+    for (n = 0; n < max; n++, pos++) {
+        slot = SLOT(ring, pos);
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1)
+            break;
+        memcpy(dst + n * ring->elemsize, slot->data, ring->elemsize);
+        __atomic_store_n(&slot->seq, pos + ring->mask + 1, __ATOMIC_RELEASE);
+    }
+
+    __atomic_store_n(&ring->tail, pos, __ATOMIC_RELAXED);
+
+    return n;
+}
+
+static int ring_ready(lgw_ring_s* ring)
+{
+    size_t pos = ring->tail;
+    return __atomic_load_n(&SLOT(ring, pos)->seq, __ATOMIC_SEQ_CST) == pos + 1;
+}
+
+int lgw_ring_wait(lgw_ring_s* ring, int timeout)
+{
+    int rc;
+
+    if (ring_ready(ring))
+        return 0;
+
+    __atomic_store_n(&ring->sleeping, 1, __ATOMIC_SEQ_CST);
+
+    /* recheck, a producer may have pushed before it could see the flag */
+    if (ring_ready(ring)) {
+        __atomic_store_n(&ring->sleeping, 0, __ATOMIC_SEQ_CST);
+        return 0;
+    }
+
+    rc = lgw_eventfd_wait(ring->efd, timeout);
+
+    __atomic_store_n(&ring->sleeping, 0, __ATOMIC_SEQ_CST);
+
+    return (rc == 0 || ring_ready(ring)) ? 0 : -1;
+}
+
+void lgw_ring_wakeup(lgw_ring_s* ring)
+{
+    lgw_eventfd_post(ring->efd);
+}
+
+size_t lgw_ring_depth(lgw_ring_s* ring)
+{
+    return __atomic_load_n(&ring->head, __ATOMIC_RELAXED) - __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+}
+
+uint64_t lgw_ring_drops(lgw_ring_s* ring)
+{
+    return __atomic_load_n(&ring->drops, __ATOMIC_RELAXED);
+}
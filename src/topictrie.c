@@ -0,0 +1,188 @@
+/*
+ *  ____  ____      _    ____ ___ _   _  ___
+ *  |  _ \|  _ \    / \  / ___|_ _| \ | |/ _ \
+ *  | | | | |_) |  / _ \| |  _ | ||  \| | | | |
+ *  | |_| |  _ <  / ___ \ |_| || || |\  | |_| |
+ *  |____/|_| \_\/_/   \_\____|___|_| \_|\___/
+ *
+ * location service -- An opensource of lorawan location service
+ *
+ * See http://www.dragino.com for more information about
+ * the lora gateway project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ *
+ * Maintainer: skerlan
+ *
+ */
+
+/*! \file
+ *
+ * \brief precompiled trie of mqtt topic filters
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "utilities.h"
+#include "topictrie.h"
+
+static trie_node_s* trie_node_new(const char* name, size_t len, uint32_t hash)
+{
+    trie_node_s* node = (trie_node_s*)lgw_malloc(sizeof(trie_node_s));
+    if (node == NULL)
+        return NULL;
+    node->name = lgw_strndup(name, len);
+    node->len = len;
+    node->hash = hash;
+    return node;
+}
+
+static void trie_node_free(trie_node_s* node)
+{
+    trie_node_s* child;
+
+    if (node == NULL)
+        return;
+
+    while ((child = node->child) != NULL) {
+        node->child = child->next;
+        trie_node_free(child);
+    }
+    trie_node_free(node->plus);
+    trie_node_free(node->multi);
+    lgw_free(node->name);
+    lgw_free(node);
+}
+
+void lgw_trie_init(lgw_trie_s* trie)
+{
+    memset(trie, 0, sizeof(lgw_trie_s));
+}
+
+int lgw_trie_insert(lgw_trie_s* trie, const char* filter, void* value)
+{
+    trie_node_s* node = &trie->root;
+    trie_node_s** link;
+    const char* level = filter;
+    const char* end;
+    size_t len;
+    uint32_t hash;
+
+    if (filter == NULL || *filter == '\0')
+        return -1;
+
+    for (;;) {
+        end = strchr(level, '/');
+        len = end ? (size_t)(end - level) : strlen(level);
+
+        if (len == 1 && level[0] == '#') {
+            if (end != NULL)    // '#' must be the last level
+                return -1;
+            link = &node->multi;
+            if (*link == NULL && (*link = trie_node_new("#", 1, 0)) == NULL)
+                return -1;
+        } else if (len == 1 && level[0] == '+') {
+            link = &node->plus;
+            if (*link == NULL && (*link = trie_node_new("+", 1, 0)) == NULL)
+                return -1;
+        } else {
+            if (memchr(level, '+', len) || memchr(level, '#', len))
+                return -1;
+            hash = lgw_str_hash(level, len);
+            for (link = &node->child; *link != NULL; link = &(*link)->next) {
+                if ((*link)->hash == hash && (*link)->len == len && !memcmp((*link)->name, level, len))
+                    break;
+            }
+            if (*link == NULL && (*link = trie_node_new(level, len, hash)) == NULL)
+                return -1;
+        }
+
+        node = *link;
+        if (end == NULL)
+            break;
+        level = end + 1;
+    }
+
+    if (node->value == NULL)
+        trie->count++;
+    node->value = value;
+
+    return 0;
+}
+
+/*!
+ * \brief match the levels [level, topic_end) below node
+ * \param level start of the current level, NULL when all levels are consumed
+ */
+
+static void* trie_match_level(const trie_node_s* node, const char* level, const char* topic_end)
+{
+    const trie_node_s* child;
+    const char* end;
+    const char* next;
+    uint32_t hash;
+    size_t len;
+    void* value;
+
+    if (level == NULL) {
+        if (node->value != NULL)
+            return node->value;
+        /* "a/#" also matches "a" */
+        return node->multi ? node->multi->value : NULL;
+    }
+
+    end = memchr(level, '/', topic_end - level);
+    if (end == NULL) {
+        end = topic_end;
+        next = NULL;
+    } else
+        next = end + 1;
+    len = end - level;
+
+    if (node->child != NULL) {
+        hash = lgw_str_hash(level, len);
+        for (child = node->child; child != NULL; child = child->next) {
+            if (child->hash != hash || child->len != len)
+                continue;
+            if (memcmp(child->name, level, len))
+                continue;
+            if ((value = trie_match_level(child, next, topic_end)) != NULL)
+                return value;
+            break;
+        }
+    }
+
+    if (node->plus != NULL && (value = trie_match_level(node->plus, next, topic_end)) != NULL)
+        return value;
+
+    if (node->multi != NULL)
+        return node->multi->value;
+
+    return NULL;
+}
+
+void* lgw_trie_match(const lgw_trie_s* trie, const char* topic, size_t len)
+{
+    if (topic == NULL || trie->count == 0)
+        return NULL;
+
+    return trie_match_level(&trie->root, topic, topic + len);
+}
+
+void lgw_trie_free(lgw_trie_s* trie)
+{
+    trie_node_s* child;
+
+    while ((child = trie->root.child) != NULL) {
+        trie->root.child = child->next;
+        trie_node_free(child);
+    }
+    trie_node_free(trie->root.plus);
+    trie_node_free(trie->root.multi);
+    lgw_trie_init(trie);
+}
@@ -28,6 +28,11 @@
 #include <stdio.h>
 #include <ctype.h>
 #include <errno.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
 
 #include "utilities.h"
 
@@ -161,6 +166,71 @@ char* lgw_gen_str(char *str, int size) {
     return str;
 }
 
+uint32_t lgw_str_hash(const char* str, size_t len)
+{
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        hash ^= (uint8_t)str[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static const uint64_t pow10_u64[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+    100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+    10000000000000ULL, 100000000000000ULL, 1000000000000000ULL
+};
+
+int lgw_dtoa_fixed(double value, int prec, char* buf)
+{
+    char digits[20];
+    uint64_t ipart, fpart;
+    double frac;
+    int n = 0, i;
+
+    if (prec < 0)
+        prec = 0;
+    else if (prec > 15)
+        prec = 15;
+
+    if (value < 0) {
+        buf[n++] = '-';
+        value = -value;
+    }
+
+    ipart = (uint64_t)value;
+    frac = value - (double)ipart;       // exact, both have the same exponent range
+    fpart = (uint64_t)(frac * pow10_u64[prec] + 0.5);
+    if (fpart >= pow10_u64[prec]) {     // rounded up to the next integer
+        fpart -= pow10_u64[prec];
+        ipart++;
+    }
+
+    i = 0;
+    do {
+        digits[i++] = '0' + ipart % 10;
+        ipart /= 10;
+    } while (ipart != 0);
+    while (i > 0)
+        buf[n++] = digits[--i];
+
+    if (prec > 0) {
+        buf[n++] = '.';
+        for (i = prec - 1; i >= 0; i--) {
+            buf[n + i] = '0' + fpart % 10;
+            fpart /= 10;
+        }
+        n += prec;
+    }
+    buf[n] = '\0';
+
+    return n;
+}
+
 struct thr_arg {
 	void *(*start_routine)(void *);
 	void *data;
@@ -248,12 +318,150 @@ int lgw_wait_sem(sem_t* sem, int timeout) {
 	int rc = -1;
 	struct timespec ts;
 	if (clock_gettime(CLOCK_REALTIME, &ts) != -1) {
-		ts.tv_sec += timeout;
+		ts.tv_sec += timeout / 1000;
+		ts.tv_nsec += (timeout % 1000) * 1000000L;
+		if (ts.tv_nsec >= 1000000000L) {
+			ts.tv_sec += 1;
+			ts.tv_nsec -= 1000000000L;
+		}
 		rc = sem_timedwait(sem, &ts);
     }
     return rc;
 }
 
+#define LGW_EVLOOP_MAX_EVENTS 16
+
+int lgw_evloop_init(lgw_evloop_s* loop)
+{
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epfd < 0) {
+        lgw_log(LOG_ERROR, "ERROR~ epoll_create1: %s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+void lgw_evloop_destroy(lgw_evloop_s* loop)
+{
+    if (loop->epfd >= 0)
+        close(loop->epfd);
+    loop->epfd = -1;
+}
+
+lgw_ev_s* lgw_evloop_add(lgw_evloop_s* loop, int fd, uint32_t events, lgw_ev_cb cb, void* data)
+{
+    struct epoll_event event;
+    lgw_ev_s* ev;
+
+    ev = lgw_malloc(sizeof(lgw_ev_s));
+    if (ev == NULL)
+        return NULL;
+
+    ev->fd = fd;
+    ev->cb = cb;
+    ev->data = data;
+
+    event.events = events;
+    event.data.ptr = ev;
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &event)) {
+        lgw_log(LOG_ERROR, "ERROR~ epoll_ctl(%d): %s\n", fd, strerror(errno));
+        lgw_free(ev);
+        return NULL;
+    }
+
+    return ev;
+}
+
+void lgw_evloop_del(lgw_evloop_s* loop, lgw_ev_s* ev)
+{
+    if (ev == NULL)
+        return;
+    epoll_ctl(loop->epfd, EPOLL_CTL_DEL, ev->fd, NULL);
+    lgw_free(ev);
+}
+
+int lgw_evloop_run(lgw_evloop_s* loop, int timeout)
+{
+    struct epoll_event events[LGW_EVLOOP_MAX_EVENTS];
+    lgw_ev_s* ev;
+    int i, n;
+
+    n = epoll_wait(loop->epfd, events, LGW_EVLOOP_MAX_EVENTS, timeout);
+    if (n < 0)
+        return (errno == EINTR) ? 0 : -1;
+
+    for (i = 0; i < n; i++) {
+        ev = (lgw_ev_s*)events[i].data.ptr;
+        ev->cb(ev->fd, events[i].events, ev->data);
+    }
+
+    return n;
+}
+
+int lgw_eventfd_create(void)
+{
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0)
+        lgw_log(LOG_ERROR, "ERROR~ eventfd: %s\n", strerror(errno));
+    return fd;
+}
+
+void lgw_eventfd_post(int fd)
+{
+    uint64_t one = 1;
+    if (write(fd, &one, sizeof(one)) != sizeof(one) && errno != EAGAIN)
+        lgw_log(LOG_WARNING, "WARNING~ eventfd write: %s\n", strerror(errno));
+}
+
+uint64_t lgw_eventfd_take(int fd)
+{
+    uint64_t count = 0;
+    if (read(fd, &count, sizeof(count)) != sizeof(count))
+        return 0;
+    return count;
+}
+
+int lgw_eventfd_wait(int fd, int timeout)
+{
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+    if (poll(&pfd, 1, timeout) <= 0)
+        return -1;
+
+    return lgw_eventfd_take(fd) ? 0 : -1;
+}
+
+int lgw_timerfd_create(int interval)
+{
+    struct itimerspec its;
+    int fd;
+
+    fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0) {
+        lgw_log(LOG_ERROR, "ERROR~ timerfd_create: %s\n", strerror(errno));
+        return -1;
+    }
+
+    its.it_interval.tv_sec = interval / 1000;
+    its.it_interval.tv_nsec = (interval % 1000) * 1000000L;
+    its.it_value = its.it_interval;
+    if (timerfd_settime(fd, 0, &its, NULL)) {
+        lgw_log(LOG_ERROR, "ERROR~ timerfd_settime: %s\n", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+int lgw_signalfd_create(const sigset_t* mask)
+{
+    int fd = signalfd(-1, mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd < 0)
+        lgw_log(LOG_ERROR, "ERROR~ signalfd: %s\n", strerror(errno));
+    return fd;
+}
+
 void DO_CRASH_NORETURN lgw_do_crash(void)
 {
 #if defined(DO_CRASH)
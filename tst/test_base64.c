@@ -0,0 +1,323 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2019 Semtech
+
+Description:
+    Round trip and corruption fuzz of the Base64 kernels against the scalar
+    path, then a microbenchmark of each kernel against the byte at a time
+    routine it replaced
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <string.h>
+#include <time.h>
+
+/* the kernels are private, the test swaps them under the public functions */
+#include "../src/base64.c"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define FUZZ_ROUNDS         20000   /* default number of random inputs per kernel */
+#define FUZZ_MAX_SIZE       700     /* bytes, above the largest kernel step */
+#define GUARD_LEN           64      /* bytes checked past max_len */
+#define BENCH_BYTES         (64 << 20)  /* bytes encoded for each size and kernel */
+
+typedef struct {
+    const char * name;
+    void (*encode)(const uint8_t * in, int size, char * out);
+    int  (*decode)(const char * in, int blocks, uint8_t * out, int max_len);
+    int available;
+} kernel_s;
+
+static const int bench_sizes[] = { 16, 64, 256, 4096 };
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static kernel_s kernels[] = {
+    { "scalar", encode_blocks_scalar, decode_blocks_scalar, 1 },
+#if defined(B64_X86)
+    { "ssse3",  encode_blocks_ssse3,  decode_blocks_ssse3,  0 },
+    { "avx2",   encode_blocks_avx2,   decode_blocks_avx2,   0 },
+#elif defined(B64_NEON)
+    { "neon",   encode_blocks_neon,   decode_blocks_neon,   1 },
+#endif
+};
+
+static uint32_t seed = 0x2545F491;
+
+static volatile int sink;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static uint32_t next_rand(void) {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+static void use_kernel(const kernel_s * k) {
+    encode_blocks = k->encode;
+    decode_blocks = k->decode;
+}
+
+static double now_s(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* the byte at a time routine of the baseline, valid input only */
+static char old_code_to_char(uint8_t x) {
+    if (x <= 25) {
+        return 'A' + x;
+    } else if (x <= 51) {
+        return 'a' + (x-26);
+    } else if (x <= 61) {
+        return '0' + (x-52);
+    } else if (x == 62) {
+        return '+';
+    } else {
+        return '/';
+    }
+}
+
+static uint8_t old_char_to_code(char x) {
+    if ((x >= 'A') && (x <= 'Z')) {
+        return (uint8_t)x - (uint8_t)'A';
+    } else if ((x >= 'a') && (x <= 'z')) {
+        return (uint8_t)x - (uint8_t)'a' + 26;
+    } else if ((x >= '0') && (x <= '9')) {
+        return (uint8_t)x - (uint8_t)'0' + 52;
+    } else if (x == '+') {
+        return 62;
+    } else {
+        return 63;
+    }
+}
+
+static int old_bin_to_b64_nopad(const uint8_t * in, int size, char * out) {
+    int i, n = 0;
+    uint32_t b;
+
+    for (i = 0; i + 3 <= size; i += 3) {
+        b = ((uint32_t)in[i] << 16) | ((uint32_t)in[i + 1] << 8) | in[i + 2];
+        out[n++] = old_code_to_char((b >> 18) & 0x3F);
+        out[n++] = old_code_to_char((b >> 12) & 0x3F);
+        out[n++] = old_code_to_char((b >> 6 ) & 0x3F);
+        out[n++] = old_code_to_char( b        & 0x3F);
+    }
+    if (size - i == 1) {
+        b = (uint32_t)in[i] << 16;
+        out[n++] = old_code_to_char((b >> 18) & 0x3F);
+        out[n++] = old_code_to_char((b >> 12) & 0x3F);
+    } else if (size - i == 2) {
+        b = ((uint32_t)in[i] << 16) | ((uint32_t)in[i + 1] << 8);
+        out[n++] = old_code_to_char((b >> 18) & 0x3F);
+        out[n++] = old_code_to_char((b >> 12) & 0x3F);
+        out[n++] = old_code_to_char((b >> 6 ) & 0x3F);
+    }
+    out[n] = 0;
+
+    return n;
+}
+
+static int old_b64_to_bin_nopad(const char * in, int size, uint8_t * out) {
+    int i, n = 0;
+    uint32_t b;
+
+    for (i = 0; i + 4 <= size; i += 4) {
+        b  = (uint32_t)old_char_to_code(in[i]    ) << 18;
+        b |= (uint32_t)old_char_to_code(in[i + 1]) << 12;
+        b |= (uint32_t)old_char_to_code(in[i + 2]) << 6;
+        b |= (uint32_t)old_char_to_code(in[i + 3]);
+        out[n++] = (b >> 16) & 0xFF;
+        out[n++] = (b >> 8 ) & 0xFF;
+        out[n++] =  b        & 0xFF;
+    }
+    if (size - i >= 2) {
+        b  = (uint32_t)old_char_to_code(in[i]    ) << 18;
+        b |= (uint32_t)old_char_to_code(in[i + 1]) << 12;
+        out[n++] = (b >> 16) & 0xFF;
+        if (size - i == 3) {
+            b |= (uint32_t)old_char_to_code(in[i + 2]) << 6;
+            out[n++] = (b >> 8) & 0xFF;
+        }
+    }
+
+    return n;
+}
+
+/* one random input through a kernel, compared with the baseline and the scalar path */
+static int fuzz_one(const kernel_s * k, const uint8_t * in, int size) {
+    static const kernel_s * scalar = &kernels[0];
+    char ref[4 * FUZZ_MAX_SIZE / 3 + 8];
+    char enc[4 * FUZZ_MAX_SIZE / 3 + 8];
+    char bad[4 * FUZZ_MAX_SIZE / 3 + 8];
+    uint8_t dec[FUZZ_MAX_SIZE + GUARD_LEN];
+    uint8_t dec_ref[FUZZ_MAX_SIZE + GUARD_LEN];
+    int len, ref_len, rc, rc_ref, pos, i;
+
+    /* encoding matches the baseline */
+    use_kernel(k);
+    ref_len = old_bin_to_b64_nopad(in, size, ref);
+    len = bin_to_b64_nopad(in, size, enc, sizeof(enc));
+    if (len != ref_len || memcmp(enc, ref, len + 1)) {
+        printf("%s: encoding of %d bytes differs\n", k->name, size);
+        return -1;
+    }
+
+    /* decoding gives the input back, nothing is written past max_len */
+    memset(dec, 0xA5, sizeof(dec));
+    rc = b64_to_bin_nopad(enc, len, dec, size);
+    if (rc != size || memcmp(dec, in, size)) {
+        printf("%s: round trip of %d bytes failed\n", k->name, size);
+        return -1;
+    }
+    for (i = size; i < size + GUARD_LEN; i++) {
+        if (dec[i] != 0xA5) {
+            printf("%s: decoding of %d bytes wrote past max_len\n", k->name, size);
+            return -1;
+        }
+    }
+
+    /* with padding too */
+    len = bin_to_b64(in, size, enc, sizeof(enc));
+    if (len < 0 || b64_to_bin(enc, len, dec, size) != size || memcmp(dec, in, size)) {
+        printf("%s: padded round trip of %d bytes failed\n", k->name, size);
+        return -1;
+    }
+
+    /* a corrupted character is rejected as the scalar path does */
+    len = bin_to_b64_nopad(in, size, enc, sizeof(enc));
+    if (len == 0)
+        return 0;
+    memcpy(bad, enc, len);
+    pos = next_rand() % len;
+    bad[pos] = (char)(next_rand() & 0xFF);
+    rc = b64_to_bin_nopad(bad, len, dec, size);
+    use_kernel(scalar);
+    rc_ref = b64_to_bin_nopad(bad, len, dec_ref, size);
+    if (rc != rc_ref || (rc >= 0 && memcmp(dec, dec_ref, rc))) {
+        printf("%s: corrupted char 0x%02X at %d of %d: %d, scalar %d\n", k->name, (uint8_t)bad[pos], pos, len, rc, rc_ref);
+        return -1;
+    }
+    if (char_to_code[(uint8_t)bad[pos]] == 0xFF && rc != -1) {
+        printf("%s: char 0x%02X out of the alphabet accepted\n", k->name, (uint8_t)bad[pos]);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int fuzz(const kernel_s * k, int rounds) {
+    uint8_t in[FUZZ_MAX_SIZE];
+    int size, i, r;
+
+    for (r = 0; r < rounds; r++) {
+        size = next_rand() % (FUZZ_MAX_SIZE + 1);
+        for (i = 0; i < size; i++)
+            in[i] = next_rand() & 0xFF;
+        if (fuzz_one(k, in, size))
+            return -1;
+    }
+
+    return 0;
+}
+
+/* MB/s of binary data, encoded then decoded, old is the baseline routine */
+static void bench(const kernel_s * k, int size, double * enc_rate, double * dec_rate) {
+    static uint8_t in[4096], out[4096];
+    static char str[4 * 4096 / 3 + 8];
+    int i, len, loops = BENCH_BYTES / size;
+    double t;
+
+    for (i = 0; i < size; i++)
+        in[i] = next_rand() & 0xFF;
+    if (k != NULL)
+        use_kernel(k);
+
+    t = now_s();
+    for (i = 0; i < loops; i++) {
+        in[0] = (uint8_t)i;
+        sink = (k != NULL) ? bin_to_b64_nopad(in, size, str, sizeof(str)) : old_bin_to_b64_nopad(in, size, str);
+    }
+    *enc_rate = (double)loops * size / (now_s() - t) / 1e6;
+
+    len = (k != NULL) ? bin_to_b64_nopad(in, size, str, sizeof(str)) : old_bin_to_b64_nopad(in, size, str);
+    t = now_s();
+    for (i = 0; i < loops; i++) {
+        sink = (k != NULL) ? b64_to_bin_nopad(str, len, out, sizeof(out)) : old_b64_to_bin_nopad(str, len, out);
+        str[0] = code_to_char[out[0] & 0x3F];
+    }
+    *dec_rate = (double)loops * size / (now_s() - t) / 1e6;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char ** argv) {
+    int rounds = FUZZ_ROUNDS;
+    int failed = 0;
+    double enc_rate, dec_rate;
+    size_t k, s;
+
+    if (argc > 1)
+        rounds = atoi(argv[1]);
+
+#if defined(B64_X86)
+    __builtin_cpu_init();
+    kernels[1].available = __builtin_cpu_supports("ssse3");
+    kernels[2].available = __builtin_cpu_supports("avx2");
+#endif
+
+    printf("fuzz, %d inputs of 0 to %d bytes per kernel\n", rounds, FUZZ_MAX_SIZE);
+    for (k = 0; k < ARRAY_SIZE(kernels); k++) {
+        if (!kernels[k].available) {
+            printf("  %-8s not supported by this CPU\n", kernels[k].name);
+            continue;
+        }
+        if (fuzz(&kernels[k], rounds)) {
+            failed = 1;
+            continue;
+        }
+        printf("  %-8s ok\n", kernels[k].name);
+    }
+
+    printf("bench, MB/s of binary data, encode / decode\n");
+    printf("  %-8s", "bytes");
+    for (s = 0; s < ARRAY_SIZE(bench_sizes); s++)
+        printf(" %15d", bench_sizes[s]);
+    printf("\n  %-8s", "old");
+    for (s = 0; s < ARRAY_SIZE(bench_sizes); s++) {
+        bench(NULL, bench_sizes[s], &enc_rate, &dec_rate);
+        printf(" %7.0f/%-7.0f", enc_rate, dec_rate);
+    }
+    for (k = 0; k < ARRAY_SIZE(kernels); k++) {
+        if (!kernels[k].available)
+            continue;
+        printf("\n  %-8s", kernels[k].name);
+        for (s = 0; s < ARRAY_SIZE(bench_sizes); s++) {
+            bench(&kernels[k], bench_sizes[s], &enc_rate, &dec_rate);
+            printf(" %7.0f/%-7.0f", enc_rate, dec_rate);
+        }
+    }
+    printf("\n");
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
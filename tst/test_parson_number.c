@@ -0,0 +1,231 @@
+/*
+ SPDX-License-Identifier: MIT
+
+ Parson ( http://kgabis.github.com/parson/ )
+ Copyright (c) 2012 - 2019 Krzysztof Gabis
+
+ Description:
+    Checks that the fast number path of the parser is bit equal to strtod
+    on numbers shaped like the uplink and beacon documents, then times
+    both
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <time.h>
+
+/* parse_number_fast is private, the test calls it directly */
+#include "../src/parson.c"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define CHECK_COUNT         2000000     /* default number of generated numbers */
+#define BENCH_COUNT         1000000     /* numbers of the timed corpus */
+#define BENCH_DOC_NUMBERS   16          /* numbers of one timed document */
+#define NUMBER_SIZE         40          /* room of one formatted number */
+
+#define ARRAY_SIZE(a)       (sizeof(a) / sizeof((a)[0]))
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+uint8_t LOG_INFO = 0;
+uint8_t LOG_WARNING = 0;
+uint8_t LOG_ERROR = 0;
+uint8_t LOG_DEBUG = 0;
+uint8_t LOG_MEM = 0;
+
+static uint64_t seed = 0x9E3779B97F4A7C15ULL;
+
+static volatile double sink;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static uint64_t next_rand(void) {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return seed;
+}
+
+static double rand_unit(void) {
+    return (next_rand() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double now_s(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* one number as the network server, the gateways and mapwize write them,
+   with stress also the numbers only strtod can decide */
+static void make_number(char *buf, size_t size, int stress) {
+    double lat = rand_unit() * 180.0 - 90.0;
+    double lon = rand_unit() * 360.0 - 180.0;
+
+    switch (next_rand() % (stress ? 12 : 10)) {
+        case 0: /* rssi, major, minor, floor */
+            snprintf(buf, size, "%d", (int)(next_rand() % 65536) - 200);
+            break;
+        case 1: /* snr */
+            snprintf(buf, size, "%.1f", (int)(next_rand() % 400) / 10.0 - 20.0);
+            break;
+        case 2: /* frequency */
+            snprintf(buf, size, "%.1f", 860.0 + (next_rand() % 200) / 10.0);
+            break;
+        case 3: /* gateway timestamp, counters */
+            snprintf(buf, size, "%llu", (unsigned long long)(next_rand() % 4294967296ULL));
+            break;
+        case 4: /* gateway coordinates */
+            snprintf(buf, size, "%.4f", lat);
+            break;
+        case 5: /* beacon location */
+            snprintf(buf, size, "%.*f", 6 + (int)(next_rand() % 10), lon);
+            break;
+        case 6: /* shortest round trip of a double, as JSON encoders print */
+            snprintf(buf, size, "%.17g", lat);
+            break;
+        case 7: /* place coordinates, PLACE_COORD_PREC */
+            snprintf(buf, size, "%.15f", lon);
+            break;
+        case 8: /* exponent forms */
+            snprintf(buf, size, "%.*e", (int)(next_rand() % 16), (rand_unit() - 0.5) * 1e3);
+            break;
+        case 9: /* zeros */
+            snprintf(buf, size, "%s", (const char *[]){ "0", "-0", "0.0", "-0.000", "0.0e-3", "0e5" }[next_rand() % (stress ? 6 : 5)]);
+            break;
+        case 10: /* too many digits for the fast path */
+            snprintf(buf, size, "%llu%llu", (unsigned long long)(next_rand() % 1000000000ULL + 1),
+                     (unsigned long long)(next_rand() % 100000000000ULL));
+            break;
+        default: /* exponents out of the exact range */
+            snprintf(buf, size, "%.3fe%d", rand_unit() * 10.0, (int)(next_rand() % 700) - 350);
+            break;
+    }
+}
+
+/* the fast path and the whole parser give the bits and the end of strtod */
+static int check_one(const char *num) {
+    const char *fast_end;
+    char *end;
+    char doc[NUMBER_SIZE + 2];
+    double fast, ref;
+    JSON_Value *value;
+    int rc = 0;
+
+    ref = strtod(num, &end);
+    if (parse_number_fast(num, &fast, &fast_end) &&
+            (memcmp(&fast, &ref, sizeof(double)) || fast_end != end)) {
+        printf("fast path: %s -> %.17g, strtod %.17g\n", num, fast, ref);
+        rc = -1;
+    }
+
+    /* a document is an object or an array, the strtod path accepts what is_decimal accepts */
+    snprintf(doc, sizeof(doc), "[%s]", num);
+    value = json_parse_string(doc);
+    if (json_value_get_type(json_array_get_value(json_value_get_array(value), 0)) != JSONNumber) {
+        if (is_decimal(num, end - num)) {
+            printf("parser: %s rejected\n", num);
+            rc = -1;
+        }
+    } else if (!is_decimal(num, end - num)) {
+        printf("parser: %s accepted\n", num);
+        rc = -1;
+    } else {
+        fast = json_array_get_number(json_value_get_array(value), 0);
+        if (memcmp(&fast, &ref, sizeof(double)) && !(isinf(ref) || isnan(ref))) {
+            printf("parser: %s -> %.17g, strtod %.17g\n", num, fast, ref);
+            rc = -1;
+        }
+    }
+    json_value_free(value);
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv) {
+    static const char *edges[] = {
+        "9007199254740992", "9007199254740993", "-9007199254740993", "1e22", "1e23",
+        "1e-22", "1e-23", "123456789012345678e-5", "1234567890123456789", "12345678901234567890",
+        "0.1", "0.3", "2.2250738585072014e-308", "4.9e-324", "1.7976931348623157e308"
+    };
+    char num[NUMBER_SIZE];
+    char *corpus, *corpus_end;
+    const char *p, *fast_end;
+    char *end;
+    double number, fast_ns, strtod_ns, parser_ns, t;
+    int count = CHECK_COUNT, fast_hits = 0, failed = 0;
+    int i;
+    JSON_Value *value;
+
+    if (argc > 1)
+        count = atoi(argv[1]);
+
+    for (i = 0; i < (int)ARRAY_SIZE(edges); i++)
+        failed |= check_one(edges[i]);
+    for (i = 0; i < count && !failed; i++) {
+        make_number(num, sizeof(num), 1);
+        failed |= check_one(num);
+        fast_hits += parse_number_fast(num, &number, &fast_end);
+    }
+    printf("check, %d uplink and beacon numbers: %s, %d%% on the fast path\n",
+           count, failed ? "FAILED" : "bit equal to strtod", count ? (int)(100.0 * fast_hits / count) : 0);
+
+    /* the corpus, documents of BENCH_DOC_NUMBERS numbers as an uplink or a beacon holds */
+    corpus = (char *)malloc((size_t)BENCH_COUNT * (NUMBER_SIZE + 1) + BENCH_COUNT / BENCH_DOC_NUMBERS * 3);
+    if (corpus == NULL)
+        return EXIT_FAILURE;
+    end = corpus;
+    for (i = 0; i < BENCH_COUNT; i++) {
+        make_number(num, sizeof(num), 0);
+        end += sprintf(end, "%c%s", i % BENCH_DOC_NUMBERS ? ',' : '[', num);
+        if (i % BENCH_DOC_NUMBERS == BENCH_DOC_NUMBERS - 1)
+            end += sprintf(end, "]") + 1;   // one string per document
+    }
+    corpus_end = end;
+
+    t = now_s();
+    for (p = corpus; p < corpus_end; p++) {
+        sink = strtod(p + 1, &end);
+        p = end;
+    }
+    strtod_ns = (now_s() - t) * 1e9 / BENCH_COUNT;
+
+    t = now_s();
+    for (p = corpus; p < corpus_end; p++) {
+        if (parse_number_fast(p + 1, &number, &fast_end)) {
+            sink = number;
+            p = fast_end;
+        } else {
+            sink = strtod(p + 1, &end);
+            p = end;
+        }
+    }
+    fast_ns = (now_s() - t) * 1e9 / BENCH_COUNT;
+
+    t = now_s();
+    for (p = corpus; p < corpus_end; p += strlen(p) + 1) {
+        value = json_parse_string(p);
+        if (json_array_get_count(json_value_get_array(value)) != BENCH_DOC_NUMBERS)
+            failed = 1;
+        json_value_free(value);
+    }
+    parser_ns = (now_s() - t) * 1e9 / BENCH_COUNT;
+    free(corpus);
+
+    printf("bench, ns per number of %d: strtod %.1f, fast path %.1f, parser of %d number documents %.1f\n",
+           BENCH_COUNT, strtod_ns, fast_ns, BENCH_DOC_NUMBERS, parser_ns);
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */